@@ -4,6 +4,13 @@
 #include "AsyncCallbackBase.h"
 #include "Callback.h"
 #include "CallbackThread.h"
+#include <type_traits>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <algorithm>
 
 // See http://www.codeproject.com/Articles/1092727/Asynchronous-Multicast-Callbacks-with-Inter-Thread
 
@@ -19,10 +26,78 @@ public:
 	/// Callback function signature
 	typedef void (*CallbackFunc)(const TData& cbData, void* userData);
 
+	/// Callback function signature taking ownership of a heap allocated copy
+	/// of the data, which the function must delete. 
+	typedef void (*TransferFunc)(TData* cbData, void* userData);
+
+	/// Callback function signature receiving a batch of items at once. 
+	typedef void (*BatchFunc)(const TData* cbData, size_t count, void* userData);
+
+	/// @see AsyncCallbackBase::Register 
+	CallbackHandle Register(CallbackFunc func, CallbackThread* thread, void* userData=NULL,
+		DispatchPolicy policy=DISPATCH_DEFAULT, CallbackPriority priority=PRIORITY_NORMAL)
+	{
+		return AsyncCallbackBase::Register(reinterpret_cast<Callback::CallbackFunc>(func), thread, userData, 
+			policy, priority);
+	}
+
+	/// Register a function that takes ownership of the callback data, for 
+	/// instance to pass it to a state machine as event data. A message with no
+	/// other subscribers hands over the heap copy made by Invoke(), so the data
+	/// is allocated and copied once. 
 	/// @see AsyncCallbackBase::Register 
-	void Register(CallbackFunc func, CallbackThread* thread, void* userData=NULL)
+	CallbackHandle Register(TransferFunc func, CallbackThread* thread, void* userData=NULL,
+		DispatchPolicy policy=DISPATCH_DEFAULT, CallbackPriority priority=PRIORITY_NORMAL)
+	{
+		return AsyncCallbackBase::Register(MakeTransferCallback(func, thread, userData, policy, priority));
+	}
+
+	/// Register a function receiving every item of an InvokeBatch() call in one
+	/// call. Invoke() calls the function with a single item. 
+	/// @see AsyncCallbackBase::Register 
+	CallbackHandle Register(BatchFunc func, CallbackThread* thread, void* userData=NULL,
+		DispatchPolicy policy=DISPATCH_DEFAULT, CallbackPriority priority=PRIORITY_NORMAL)
+	{
+		return AsyncCallbackBase::Register(MakeBatchCallback(func, thread, userData, policy, priority));
+	}
+
+	/// Register a callable target, such as a lambda, called with the callback 
+	/// data. The callable is stored inline in the invocation list without heap 
+	/// allocation. Unregister using the returned handle. 
+	/// @param[in] callable - a trivially copyable callable invocable as 
+	///		callable(const TData&) no larger than Callback::CALLABLE_SIZE, for 
+	///		instance a lambda capturing a few pointers or values. 
+	/// @param[in] thread - target thread to execute the asynchronous callback.
+	/// @param[in] policy - the dispatch policy when invoked on the target thread.
+	/// @param[in] priority - the priority lane for the callback messages. 
+	/// @return A handle to unregister the callback. 
+	template <class TCallable>
+	CallbackHandle Register(const TCallable& callable, CallbackThread* thread,
+		DispatchPolicy policy=DISPATCH_DEFAULT, CallbackPriority priority=PRIORITY_NORMAL)
+	{
+		static_assert(IsCallable<TCallable>::value, "Callable must be invocable as callable(const TData&)");
+
+		Callback callback(reinterpret_cast<Callback::CallbackFunc>(&InvokeCallable<TCallable>), thread, 
+			NULL, policy, priority);
+		callback.SetCallable(callable);
+		return AsyncCallbackBase::Register(callback);
+	}
+
+	/// Register a member function called on an object. Unregister using the 
+	/// returned handle. 
+	/// @param[in] method - the member function called with the callback data.
+	/// @param[in] object - the object the member function is called on.
+	/// @param[in] thread - target thread to execute the asynchronous callback.
+	/// @param[in] policy - the dispatch policy when invoked on the target thread.
+	/// @param[in] priority - the priority lane for the callback messages. 
+	/// @return A handle to unregister the callback. 
+	template <class TClass>
+	CallbackHandle Register(void (TClass::*method)(const TData&), TClass* object, CallbackThread* thread,
+		DispatchPolicy policy=DISPATCH_DEFAULT, CallbackPriority priority=PRIORITY_NORMAL)
 	{
-		AsyncCallbackBase::Register(reinterpret_cast<Callback::CallbackFunc>(func), thread, userData);
+		ASSERT_TRUE(object != NULL);
+		BoundMethod<TClass> bound = { method, object };
+		return Register(bound, thread, policy, priority);
 	}
 
 	/// @see AsyncCallbackBase::Unregister
@@ -31,39 +106,124 @@ public:
 		AsyncCallbackBase::Unregister(reinterpret_cast<Callback::CallbackFunc>(func), thread, userData);
 	}
 
+	/// @see AsyncCallbackBase::Unregister
+	void Unregister(TransferFunc func, CallbackThread* thread, void* userData=NULL)
+	{
+		AsyncCallbackBase::Unregister(MakeTransferCallback(func, thread, userData, DISPATCH_DEFAULT, PRIORITY_NORMAL));
+	}
+
+	/// @see AsyncCallbackBase::Unregister
+	void Unregister(BatchFunc func, CallbackThread* thread, void* userData=NULL)
+	{
+		AsyncCallbackBase::Unregister(MakeBatchCallback(func, thread, userData, DISPATCH_DEFAULT, PRIORITY_NORMAL));
+	}
+
+	/// @see AsyncCallbackBase::Unregister
+	bool Unregister(CallbackHandle handle)
+	{
+		return AsyncCallbackBase::Unregister(handle);
+	}
+
 	/// @see Invoke
-	void operator()(const TData& data) 
+	bool operator()(const TData& data) 
+	{
+		return Invoke(data);
+	}
+
+	/// Called to invoke callbacks on all registered clients using the priority
+	/// lane each client registered with. 
+	/// @see Invoke(const TData&, CallbackPriority)
+	bool Invoke(const TData& data)
 	{
-		Invoke(data);
+		return Invoke(data, PRIORITY_LANES);
 	}
 
-	/// Called to invoke callbacks on all registered clients.
+	/// Called to invoke callbacks on all registered clients. A DISPATCH_INLINE 
+	/// callback invoked on its own target thread executes before Invoke() returns.
+	/// Invoke() uses a snapshot of the registered clients, so a client 
+	/// unregistered during the call may still be dispatched to. The data is
+	/// copied once and the copy is shared by all queued callbacks, which may 
+	/// read it concurrently from different threads. Clients queued onto the 
+	/// same thread with the same priority and dispatch policy are delivered 
+	/// by a single message in registration order, unless the thread has 
+	/// several consumers. 
 	/// @param[in] data - the data to pass to each client callback function
 	///		argument.
-	void Invoke(const TData& data) 
+	/// @param[in] priority - the priority lane for all callback messages. 
+	///		PRIORITY_LANES uses the priority each client registered with. 
+	/// @return TRUE if the callback was dispatched to every registered client. 
+	///		FALSE if any callback thread rejected or dropped the message. With 
+	///		fan-out, only dispatches made by the invoking thread are reported.
+	/// @see SetFanOut
+	bool Invoke(const TData& data, CallbackPriority priority) 
 	{
-		const std::lock_guard<std::mutex> lock(GetLock());
+		// Snapshot the invocation list. Register() and Unregister() don't 
+		// block concurrent invokers and vice versa. 
+		std::shared_ptr<const InvocationList> list = GetInvocationList();
+		if (!list)
+			return true;
 
-		// For each registered callback 
-		InvocationNode* node = GetInvocationHead();
-		while (node != NULL)
+		const size_t count = list->GetCount();
+		const INT64 deadlineNs = GetDeadline();
+
+		// Hand most of a wide invocation list to the fan-out thread
+		CallbackThread* fanOutThread = GetFanOutThread();
+		if (fanOutThread != NULL && count > GetFanOutThreshold())
 		{
-			// Create a new instance of callback and copy
-			const Callback* callback = new Callback(*node->CallbackElement);
+			// The invoker holds a reference until its share is dispatched
+			SharedData* sharedData = new SharedData(new TData(data), 1);
+			bool dispatched = FanOut(list, sharedData, priority, deadlineNs, 0, count);
+			sharedData->Release();
+			return dispatched;
+		}
+
+		SharedData* sharedData = NULL;
+		return Deliver(*list, 0, count, data, sharedData, priority, deadlineNs);
+	}
 
-			// Create a new instance of the callback data and copy
-			const TData* callbackData = new TData(data);
+	/// Called to invoke callbacks on all registered clients with a batch of 
+	/// items, such as a burst of samples. The items are copied once and each
+	/// target thread receives the whole batch in one message, instead of one 
+	/// message per item. A BatchFunc client is called once with all items. 
+	/// Other clients are called once per item in order. Fan-out is not used.
+	/// @param[in] data - the items to pass to the clients. 
+	/// @param[in] count - the number of items. 
+	/// @param[in] priority - the priority lane for all callback messages. 
+	///		PRIORITY_LANES uses the priority each client registered with. 
+	/// @return TRUE if the batch was dispatched to every registered client. 
+	///		FALSE if any callback thread rejected or dropped the message. 
+	/// @see Invoke(const TData&, CallbackPriority)
+	bool InvokeBatch(const TData* data, size_t count, CallbackPriority priority = PRIORITY_LANES)
+	{
+		std::shared_ptr<const InvocationList> list = GetInvocationList();
+		if (!list || count == 0)
+			return true;
+		ASSERT_TRUE(data != NULL);
 
-			// Create a new message  instance 
-			CallbackMsg* msg = new CallbackMsg(this, callback, callbackData);
+		const size_t end = list->GetCount();
+		DeliveryPlan plan;
+		bool dispatched = GroupCallbacks(*list, 0, end, data, count, priority, plan);
+		const std::vector<DeliveryGroup>& groups = plan.Groups;
+		if (groups.empty())
+			return dispatched;
 
-			// Dispatch message onto the callback destination thread. TargetInvoke()
-			// will be called by the target thread. 
-			callback->GetCallbackThread()->DispatchCallback(msg);
+		// Copy the items once. Each message holds one reference. 
+		const SharedBatch* batch = new SharedBatch(data, count, static_cast<UINT32>(groups.size()));
+		const INT64 deadlineNs = GetDeadline();
+
+		for (size_t i = 0; i < groups.size(); i++)
+		{
+			const DeliveryGroup& group = groups[i];
+			BatchGroupData* batchData = new BatchGroupData(batch);
+			GetMembers(*list, plan, group, batchData->Callbacks);
 
-			// Get the next registered callback subscriber 
-			node = node->Next;
+			CallbackMsg* msg = new CallbackMsg(this, Callback(NULL, group.First->GetCallbackThread(),
+				NULL, group.Policy, group.Priority), batchData, group.Priority, DELIVERY_BATCH);
+			msg->SetDeadline(deadlineNs);
+			if (!group.First->GetCallbackThread()->DispatchCallback(msg))
+				dispatched = false;
 		}
+		return dispatched;
 	}
 
 	/// Called from the destination callback thread of control. 
@@ -73,22 +233,577 @@ public:
 	virtual void TargetInvoke(CallbackMsg** msg) const
 	{
 		const Callback* callback = (*msg)->GetCallback();
+		const DeliveryKind kind = (*msg)->GetKind();
+
+		// Forward or deliver a range of slots on the fan-out thread
+		if (kind == DELIVERY_FAN_OUT)
+		{
+			const FanOutTask* task = static_cast<const FanOutTask*>((*msg)->GetCallbackData());
+			FanOut(task->List, task->Data, task->Priority, task->DeadlineNs, task->Begin, task->End);
+			TargetDiscard(msg);
+			return;
+		}
+
+		// Call each callback of a batch message with all items in order
+		CallbackThread* thread = callback->GetCallbackThread();
+		if (kind == DELIVERY_BATCH)
+		{
+			const BatchGroupData* batchData = static_cast<const BatchGroupData*>((*msg)->GetCallbackData());
+			const std::vector<TData>& items = batchData->Data->Items;
+			for (size_t i = 0; i < batchData->Callbacks.size(); i++)
+			{
+				const Callback& member = batchData->Callbacks[i];
+				if (IsCancelled(member))
+					continue;
+				thread->BeginCallback(GetTargetFunction(member), member.GetUserData());
+				CallItems(member, &items[0], items.size());
+				thread->EndCallback();
+			}
+			TargetDiscard(msg);
+			return;
+		}
 
-		// Typecast the void* back to a TData type
-		const TData* callbackData = static_cast<const TData*>((*msg)->GetCallbackData());
+		// Call each callback of a grouped message in registration order
+		if (kind == DELIVERY_GROUP)
+		{
+			const GroupData* groupData = static_cast<const GroupData*>((*msg)->GetCallbackData());
+			const size_t last = groupData->Callbacks.size() - 1;
+			for (size_t i = 0; i < groupData->Callbacks.size(); i++)
+			{
+				const Callback& member = groupData->Callbacks[i];
+				if (IsCancelled(member))
+					continue;
+				thread->BeginCallback(GetTargetFunction(member), member.GetUserData());
+
+				// Only the last member may take the data since the others read it
+				if (i == last && member.GetCallbackFunction() == GetTransferFunc())
+					Transfer(groupData->Data, member);
+				else
+				{
+					CallbackFunc func = reinterpret_cast<CallbackFunc>(member.GetCallbackFunction());
+					(*func)(*groupData->Data->Data, member.GetCallbackArgument());
+				}
+				thread->EndCallback();
+			}
+			TargetDiscard(msg);
+			return;
+		}
+
+		// Typecast the void* back to the shared callback data
+		const SharedData* sharedData = static_cast<const SharedData*>((*msg)->GetCallbackData());
+
+		// Client unregistered after the message was dispatched?
+		if (IsCancelled(*callback))
+		{
+			TargetDiscard(msg);
+			return;
+		}
+
+		if (callback->GetCallbackFunction() == GetTransferFunc())
+		{
+			// Hand the data over to a function that takes ownership
+			Transfer(sharedData, *callback);
+		}
+		else
+		{
+			// Typecast a generic callback function pointer to the CallbackFunc type
+			CallbackFunc func = reinterpret_cast<CallbackFunc>(callback->GetCallbackFunction());
+
+			// Execute the registered callback function
+			(*func)(*sharedData->Data, callback->GetCallbackArgument());
+		}
 
-		// Typecast a generic callback function pointer to the CallbackFunc type
-		CallbackFunc func = reinterpret_cast<CallbackFunc>(callback->GetCallbackFunction());
+		// Release the data sent through the message queue
+		TargetDiscard(msg);
+	}
 
-		// Execute the registered callback function
-		(*func)(*callbackData, callback->GetUserData());
+	/// @see AsyncCallbackBase::GetTargetFunction
+	virtual Callback::CallbackFunc GetTargetFunction(const Callback& callback) const
+	{
+		if (callback.GetCallbackFunction() == GetTransferFunc())
+		{
+			const TransferTarget* target = static_cast<const TransferTarget*>(callback.GetCallbackArgument());
+			return reinterpret_cast<Callback::CallbackFunc>(target->Func);
+		}
+		if (callback.GetCallbackFunction() == GetBatchFunc())
+		{
+			const BatchTarget* target = static_cast<const BatchTarget*>(callback.GetCallbackArgument());
+			return reinterpret_cast<Callback::CallbackFunc>(target->Func);
+		}
+		return callback.GetCallbackFunction();
+	}
 
-		// Delete dynamically data sent through the message queue
-		delete callbackData;
-		delete callback;
+	/// Called by the callback thread to delete a message that is not invoked. 
+	/// @param[in] msg - the callback message to delete. 
+	/// @post The msg object is deleted before this function returns. 
+	virtual void TargetDiscard(CallbackMsg** msg) const
+	{
+		switch ((*msg)->GetKind())
+		{
+		case DELIVERY_GROUP:
+			delete static_cast<const GroupData*>((*msg)->GetCallbackData());
+			break;
+		case DELIVERY_BATCH:
+			delete static_cast<const BatchGroupData*>((*msg)->GetCallbackData());
+			break;
+		case DELIVERY_FAN_OUT:
+			delete static_cast<const FanOutTask*>((*msg)->GetCallbackData());
+			break;
+		default:
+			static_cast<const SharedData*>((*msg)->GetCallbackData())->Release();
+			break;
+		}
 		delete *msg;
 		*msg = NULL;
 	}
+
+private:
+	/// @brief Callback data shared by every message of one Invoke() call. 
+	/// Deleted when the last message is invoked or discarded. Read-only while
+	/// more than one message holds a reference. 
+	struct SharedData
+	{
+		/// Constructor
+		/// @param[in] data - the heap copy of the callback data. Owned. 
+		/// @param[in] refCount - the initial number of references. 
+		SharedData(TData* data, UINT32 refCount) : RefCount(refCount), Data(data) {}
+		~SharedData() { delete Data; }
+
+		/// Check if the caller holds the only reference. 
+		bool IsUnique() const { return RefCount.load(std::memory_order_acquire) == 1; }
+
+		/// Add references. 
+		/// @pre The caller holds a reference. 
+		void AddRef(UINT32 count) const { RefCount.fetch_add(count, std::memory_order_relaxed); }
+
+		void Release() const
+		{
+			if (RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete this;
+		}
+
+		mutable std::atomic<UINT32> RefCount;
+
+		/// The data. NULL once handed over to a TransferFunc. 
+		TData* Data;
+	};
+
+	/// @brief The callbacks delivered by one grouped message. Owns one of the
+	/// shared data references. 
+	struct GroupData
+	{
+		GroupData(const SharedData* data) : Data(data) {}
+		~GroupData() { Data->Release(); }
+
+		const SharedData* Data;
+		std::vector<Callback> Callbacks;
+	};
+
+	/// @brief The items of one InvokeBatch() call shared by its messages. 
+	/// Deleted when the last message is invoked or discarded. 
+	struct SharedBatch
+	{
+		SharedBatch(const TData* data, size_t count, UINT32 refCount) : 
+			RefCount(refCount), Items(data, data + count) {}
+
+		void Release() const
+		{
+			if (RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete this;
+		}
+
+		mutable std::atomic<UINT32> RefCount;
+		const std::vector<TData> Items;
+	};
+
+	/// @brief The callbacks delivered a batch by one message. Owns one of the
+	/// batch references. 
+	struct BatchGroupData
+	{
+		BatchGroupData(const SharedBatch* data) : Data(data) {}
+		~BatchGroupData() { Data->Release(); }
+
+		const SharedBatch* Data;
+		std::vector<Callback> Callbacks;
+	};
+
+	/// @brief Queued callbacks sharing a thread, priority and dispatch policy. 
+	/// Members are chained from FirstSlot to LastSlot through DeliveryPlan::Next.
+	struct DeliveryGroup
+	{
+		const Callback* First;
+		CallbackPriority Priority;
+		DispatchPolicy Policy;
+		size_t Members;
+		size_t FirstSlot;
+		size_t LastSlot;
+	};
+
+	/// @brief The delivery groups found by one pass over a range of slots
+	struct DeliveryPlan
+	{
+		DeliveryPlan() : Begin(0) {}
+
+		std::vector<DeliveryGroup> Groups;
+
+		/// The next slot of the same group, indexed by slot - Begin. Empty 
+		/// while every group has a single member. 
+		std::vector<size_t> Next;
+		size_t Begin;
+	};
+
+	/// @brief Identifies a delivery group while grouping
+	struct DeliveryKey
+	{
+		const CallbackThread* Thread;
+		CallbackPriority Priority;
+		DispatchPolicy Policy;
+
+		bool operator==(const DeliveryKey& rhs) const
+		{
+			return Thread == rhs.Thread && Priority == rhs.Priority && Policy == rhs.Policy;
+		}
+	};
+
+	struct DeliveryKeyHash
+	{
+		size_t operator()(const DeliveryKey& key) const
+		{
+			return std::hash<const void*>()(key.Thread) ^ 
+				(static_cast<size_t>(key.Priority) << 8 | static_cast<size_t>(key.Policy));
+		}
+	};
+
+	/// Detects a callable invocable with the callback data
+	template <class TCallable, class = void>
+	struct IsCallable : std::false_type {};
+
+	template <class TCallable>
+	struct IsCallable<TCallable, decltype(void(std::declval<const TCallable&>()(std::declval<const TData&>())))> : 
+		std::true_type {};
+
+	/// Calls a callable stored inline in a Callback. 
+	template <class TCallable>
+	static void InvokeCallable(const TData& data, void* callable)
+	{
+		(*static_cast<const TCallable*>(callable))(data);
+	}
+
+	/// @brief A member function bound to an object
+	template <class TClass>
+	struct BoundMethod
+	{
+		void (TClass::*Method)(const TData&);
+		TClass* Object;
+
+		void operator()(const TData& data) const { (Object->*Method)(data); }
+	};
+
+	/// Call a callback with items. A BatchFunc is called once with all items,
+	/// any other callback once per item. 
+	static void CallItems(const Callback& callback, const TData* data, size_t count)
+	{
+		if (callback.GetCallbackFunction() == GetBatchFunc())
+		{
+			const BatchTarget* target = static_cast<const BatchTarget*>(callback.GetCallbackArgument());
+			(*target->Func)(data, count, target->UserData);
+			return;
+		}
+
+		CallbackFunc func = reinterpret_cast<CallbackFunc>(callback.GetCallbackFunction());
+		for (size_t i = 0; i < count; i++)
+			(*func)(data[i], callback.GetCallbackArgument());
+	}
+
+	/// Call the inline callbacks and pass the items to copy transports in a
+	/// range of slots, then group the remaining callbacks by target thread, 
+	/// priority and dispatch policy. 
+	/// @param[in] list - the invocation list. 
+	/// @param[in] begin - the first slot. 
+	/// @param[in] end - one past the last slot. 
+	/// @param[in] data - the items. 
+	/// @param[in] count - the number of items. 
+	/// @param[in] priority - the Invoke() priority. 
+	/// @param[out] plan - the groups to dispatch messages to. 
+	/// @return TRUE if every copy transport accepted the items. 
+	bool GroupCallbacks(const InvocationList& list, size_t begin, size_t end, const TData* data, size_t count,
+		CallbackPriority priority, DeliveryPlan& plan) const
+	{
+		bool dispatched = true;
+		std::unordered_map<DeliveryKey, size_t, DeliveryKeyHash> index;
+		plan.Begin = begin;
+
+		// For each registered callback 
+		for (size_t slot = begin; slot < end; slot++)
+		{
+			if (list.GetSlot(slot).Removed.load(std::memory_order_acquire))
+				continue;
+
+			const Callback* callback = &list.GetSlot(slot).CallbackElement;
+			const DispatchPolicy policy = GetDispatchPolicy(*callback);
+
+			// Already executing on the target thread? Call the callback function 
+			// directly without creating a message. 
+			if (policy == DISPATCH_INLINE && 
+				callback->GetCallbackThread()->IsCurrentThread())
+			{
+				CallItems(*callback, data, count);
+				continue;
+			}
+
+			// A copy transport takes the data as-is without a heap copy
+			if (std::is_trivially_copyable<TData>::value && 
+				callback->GetCallbackThread()->IsCopyTransport())
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					if (!callback->GetCallbackThread()->DispatchData(*callback, &data[i], sizeof(TData)))
+						dispatched = false;
+				}
+				continue;
+			}
+
+			// Add the callback to the group for its thread, if any. Callbacks 
+			// on a multi-consumer thread are never grouped so its consumers 
+			// can run them in parallel. 
+			const CallbackPriority lane = priority != PRIORITY_LANES ? priority : callback->GetPriority();
+			if (!callback->GetCallbackThread()->IsMultiConsumer())
+			{
+				const DeliveryKey key = { callback->GetCallbackThread(), lane, policy };
+				std::pair<typename std::unordered_map<DeliveryKey, size_t, DeliveryKeyHash>::iterator, bool> found = 
+					index.insert(std::make_pair(key, plan.Groups.size()));
+				if (!found.second)
+				{
+					DeliveryGroup& group = plan.Groups[found.first->second];
+					if (plan.Next.empty())
+						plan.Next.resize(end - begin);
+					plan.Next[group.LastSlot - begin] = slot;
+					group.LastSlot = slot;
+					group.Members++;
+					continue;
+				}
+			}
+			DeliveryGroup group = { callback, lane, policy, 1, slot, slot };
+			plan.Groups.push_back(group);
+		}
+		return dispatched;
+	}
+
+	/// Copy the callbacks of a group in registration order. A client 
+	/// unregistered since GroupCallbacks() is skipped. 
+	/// @param[in] plan - the plan holding the group. 
+	/// @param[in] group - the group. 
+	/// @param[out] callbacks - the group members. 
+	void GetMembers(const InvocationList& list, const DeliveryPlan& plan, const DeliveryGroup& group, 
+		std::vector<Callback>& callbacks) const
+	{
+		callbacks.reserve(group.Members);
+		for (size_t slot = group.FirstSlot; ; slot = plan.Next[slot - plan.Begin])
+		{
+			const InvocationSlot& invocationSlot = list.GetSlot(slot);
+			if (!invocationSlot.Removed.load(std::memory_order_acquire))
+				callbacks.push_back(invocationSlot.CallbackElement);
+			if (slot == group.LastSlot)
+				break;
+		}
+	}
+
+	/// Dispatch the callback to the registered clients in a range of slots. 
+	/// @param[in] list - the invocation list. 
+	/// @param[in] begin - the first slot. 
+	/// @param[in] end - one past the last slot. 
+	/// @param[in] data - the callback data. 
+	/// @param[in,out] sharedData - the shared copy of data. Allocated when NULL
+	///		and a message is needed, otherwise referenced once per message. 
+	/// @param[in] priority - the Invoke() priority. 
+	/// @param[in] deadlineNs - the message deadline. 
+	/// @return TRUE if dispatched to every client in the range. 
+	bool Deliver(const InvocationList& list, size_t begin, size_t end, const TData& data, 
+		SharedData*& sharedData, CallbackPriority priority, INT64 deadlineNs) const
+	{
+		// Queued callbacks grouped by target thread, priority and policy
+		DeliveryPlan plan;
+		bool dispatched = GroupCallbacks(list, begin, end, &data, 1, priority, plan);
+		const std::vector<DeliveryGroup>& groups = plan.Groups;
+
+		if (groups.empty())
+			return dispatched;
+
+		// Copy the callback data once and share the copy with every message.
+		// Each message holds one reference. 
+		if (sharedData == NULL)
+			sharedData = new SharedData(new TData(data), static_cast<UINT32>(groups.size()));
+		else
+			sharedData->AddRef(static_cast<UINT32>(groups.size()));
+
+		// Messages refer to the AsyncCallback to call TargetInvoke()
+		AsyncCallbackBase* asyncCallback = const_cast<AsyncCallback*>(this);
+
+		for (size_t i = 0; i < groups.size(); i++)
+		{
+			const DeliveryGroup& group = groups[i];
+			CallbackMsg* msg;
+			if (group.Members == 1)
+			{
+				// Create a new message instance with a copy of the callback
+				msg = new CallbackMsg(asyncCallback, *group.First, sharedData, group.Priority);
+			}
+			else
+			{
+				// One message calls every callback in the group in order. A client
+				// unregistered since the first pass is skipped. 
+				GroupData* groupData = new GroupData(sharedData);
+				GetMembers(list, plan, group, groupData->Callbacks);
+
+				msg = new CallbackMsg(asyncCallback, Callback(NULL, group.First->GetCallbackThread(), 
+					NULL, group.Policy, group.Priority), groupData, group.Priority, DELIVERY_GROUP);
+			}
+			msg->SetDeadline(deadlineNs);
+
+			// Dispatch message onto the callback destination thread. TargetInvoke()
+			// will be called by the target thread. 
+			if (!group.First->GetCallbackThread()->DispatchCallback(msg))
+				dispatched = false;
+		}
+		return dispatched;
+	}
+
+	/// @brief A range of slots forwarded to the fan-out thread. Holds one
+	/// shared data reference. 
+	struct FanOutTask
+	{
+		FanOutTask(const std::shared_ptr<const InvocationList>& list, SharedData* data, 
+			CallbackPriority priority, INT64 deadlineNs, size_t begin, size_t end) :
+			List(list), Data(data), Priority(priority), DeadlineNs(deadlineNs), Begin(begin), End(end)
+		{
+			Data->AddRef(1);
+		}
+		~FanOutTask() { Data->Release(); }
+
+		std::shared_ptr<const InvocationList> List;
+		SharedData* Data;
+		CallbackPriority Priority;
+		INT64 DeadlineNs;
+		size_t Begin;
+		size_t End;
+	};
+
+	/// Split a range of slots in half until no larger than the fan-out 
+	/// threshold, forwarding each upper half to the fan-out thread, then 
+	/// deliver the remaining range. Forwarded ranges split the same way, 
+	/// so the forwarding forms a tree. 
+	/// @pre The caller holds a reference to sharedData. 
+	/// @return TRUE if every forward and dispatch made by this thread succeeded.
+	bool FanOut(const std::shared_ptr<const InvocationList>& list, SharedData* sharedData, 
+		CallbackPriority priority, INT64 deadlineNs, size_t begin, size_t end) const
+	{
+		bool dispatched = true;
+
+		// A range is always delivered once the threshold is reached, so 
+		// forwarding ends even if fan-out is reconfigured meanwhile
+		CallbackThread* fanOutThread = GetFanOutThread();
+		const size_t threshold = std::max<size_t>(GetFanOutThreshold(), 1);
+		while (fanOutThread != NULL && end - begin > threshold)
+		{
+			const size_t middle = begin + (end - begin) / 2;
+			FanOutTask* task = new FanOutTask(list, sharedData, priority, deadlineNs, middle, end);
+
+			// Forward ahead of ordinary messages to keep the tree moving
+			CallbackMsg* msg = new CallbackMsg(const_cast<AsyncCallback*>(this), 
+				Callback(NULL, fanOutThread, NULL, DISPATCH_QUEUED, PRIORITY_HIGH), task, PRIORITY_HIGH, 
+				DELIVERY_FAN_OUT);
+			msg->SetDeadline(deadlineNs);
+			if (!fanOutThread->DispatchCallback(msg))
+				dispatched = false;
+			end = middle;
+		}
+
+		SharedData* data = sharedData;
+		if (!Deliver(*list, begin, end, *sharedData->Data, data, priority, deadlineNs))
+			dispatched = false;
+		return dispatched;
+	}
+
+	/// @brief A function taking ownership of the callback data
+	struct TransferTarget
+	{
+		TransferFunc Func;
+		void* UserData;
+	};
+
+	/// Create the callback for a TransferFunc. The target is stored inline so
+	/// callbacks compare equal only for the same function and user data. 
+	static Callback MakeTransferCallback(TransferFunc func, CallbackThread* thread, void* userData,
+		DispatchPolicy policy, CallbackPriority priority)
+	{
+		TransferTarget target = { func, userData };
+		Callback callback(GetTransferFunc(), thread, userData, policy, priority);
+		callback.SetCallable(target, true);
+		return callback;
+	}
+
+	/// Calls a TransferFunc with a heap copy of the data. Used when the data 
+	/// is shared with other callbacks or dispatched inline. 
+	static void InvokeTransfer(const TData& data, void* target)
+	{
+		const TransferTarget* transferTarget = static_cast<const TransferTarget*>(target);
+		(*transferTarget->Func)(new TData(data), transferTarget->UserData);
+	}
+
+	static Callback::CallbackFunc GetTransferFunc() 
+	{ 
+		return reinterpret_cast<Callback::CallbackFunc>(&AsyncCallback::InvokeTransfer); 
+	}
+
+	/// Hand the shared data over to a TransferFunc. The heap copy itself is
+	/// handed over when no other message can read it, otherwise the function
+	/// receives its own copy. 
+	/// @pre The caller holds a reference to sharedData. 
+	static void Transfer(const SharedData* sharedData, const Callback& callback)
+	{
+		const TransferTarget* target = static_cast<const TransferTarget*>(callback.GetCallbackArgument());
+		if (sharedData->IsUnique())
+		{
+			// The only reference is the caller's so nothing else reads the data
+			TData* data = sharedData->Data;
+			const_cast<SharedData*>(sharedData)->Data = NULL;
+			(*target->Func)(data, target->UserData);
+		}
+		else
+		{
+			InvokeTransfer(*sharedData->Data, const_cast<TransferTarget*>(target));
+		}
+	}
+
+	/// @brief A function receiving a batch of items
+	struct BatchTarget
+	{
+		BatchFunc Func;
+		void* UserData;
+	};
+
+	/// Create the callback for a BatchFunc. The target is stored inline so
+	/// callbacks compare equal only for the same function and user data. 
+	static Callback MakeBatchCallback(BatchFunc func, CallbackThread* thread, void* userData,
+		DispatchPolicy policy, CallbackPriority priority)
+	{
+		BatchTarget target = { func, userData };
+		Callback callback(GetBatchFunc(), thread, userData, policy, priority);
+		callback.SetCallable(target, true);
+		return callback;
+	}
+
+	/// Calls a BatchFunc with a single item. 
+	static void InvokeBatchItem(const TData& data, void* target)
+	{
+		const BatchTarget* batchTarget = static_cast<const BatchTarget*>(target);
+		(*batchTarget->Func)(&data, 1, batchTarget->UserData);
+	}
+
+	static Callback::CallbackFunc GetBatchFunc() 
+	{ 
+		return reinterpret_cast<Callback::CallbackFunc>(&AsyncCallback::InvokeBatchItem); 
+	}
 };
 
 #endif
\ No newline at end of file
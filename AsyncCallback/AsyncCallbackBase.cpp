@@ -1,10 +1,22 @@
 #include "AsyncCallbackBase.h"
+#include <algorithm>
+
+// Smallest invocation list allocated
+static const size_t MIN_CAPACITY = 4;
+
+// Registration entry slot for an unregistered ID
+static const UINT32 INVALID_SLOT = 0xFFFFFFFF;
 
 //------------------------------------------------------------------------------
 // Constructor
 //------------------------------------------------------------------------------
 AsyncCallbackBase::AsyncCallbackBase() :
-	m_invocationHead(NULL)
+	m_epochs(NULL),
+	m_cancelled(0),
+	m_removedCount(0),
+	m_timeToLiveMs(0),
+	m_fanOutThread(NULL),
+	m_fanOutThreshold(0)
 {
 }
 
@@ -18,60 +30,108 @@ AsyncCallbackBase::~AsyncCallbackBase()
 //------------------------------------------------------------------------------
 // Register
 //------------------------------------------------------------------------------
-void AsyncCallbackBase::Register(Callback::CallbackFunc func, CallbackThread* thread, void* userData)
+CallbackHandle AsyncCallbackBase::Register(Callback::CallbackFunc func, CallbackThread* thread, void* userData,
+	DispatchPolicy policy, CallbackPriority priority)
+{
+	return Register(Callback(func, thread, userData, policy, priority));
+}
+
+//------------------------------------------------------------------------------
+// Register
+//------------------------------------------------------------------------------
+CallbackHandle AsyncCallbackBase::Register(const Callback& callback)
 {
 	const std::lock_guard<std::mutex> lock(m_lock);
-	
-	InvocationNode* node = new InvocationNode();
-	node->CallbackElement = new Callback(func, thread, userData);
-	
-	// First element in the list?
-	if (m_invocationHead == NULL)
+
+	// Grow into a new list when full, dropping removed slots
+	InvocationList* list = m_invocationList.get();
+	if (list == NULL || list->GetCount() == list->GetCapacity())
 	{
-		// Set the head element
-		m_invocationHead = node;
+		size_t registered = list ? list->GetCount() - m_removedCount : 0;
+		Compact(std::max<size_t>(MIN_CAPACITY, registered * 2));
+		list = m_invocationList.get();
+	}
+
+	// Allocate a registration ID
+	UINT32 id;
+	if (!m_freeIds.empty())
+	{
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
 	}
 	else
 	{
-		// Iterate over list until the end of list is found
-		InvocationNode* curr = m_invocationHead;
-		while (curr->Next != NULL)
-			curr = curr->Next;
-		
-		// Set the info pointer at the end of the list
-		curr->Next = node;
+		id = static_cast<UINT32>(m_registrations.size());
+		RegistrationEntry entry = { INVALID_SLOT, 0 };
+		m_registrations.push_back(entry);
 	}
+
+	// Messages copied from the slot are cancelled once the generation changes
+	UINT32 generation = m_registrations[id].Generation;
+	SetEpoch(id, generation);
+
+	// Write the next unused slot then publish it to invokers
+	size_t slot = list->GetCount();
+	list->GetSlot(slot).CallbackElement = callback;
+	list->GetSlot(slot).CallbackElement.m_handle = CallbackHandle(id + 1, generation);
+	list->GetSlot(slot).Id = id;
+	list->GetSlot(slot).Generation = generation;
+	list->GetSlot(slot).Removed.store(false, std::memory_order_relaxed);
+	list->Append();
+
+	m_registrations[id].Slot = static_cast<UINT32>(slot);
+	return CallbackHandle(id + 1, generation);
 }
 
 //------------------------------------------------------------------------------
 // Unregister
 //------------------------------------------------------------------------------
 void AsyncCallbackBase::Unregister(Callback::CallbackFunc func, CallbackThread* thread, void* userData)
+{
+	Unregister(Callback(func, thread, userData));
+}
+
+//------------------------------------------------------------------------------
+// Unregister
+//------------------------------------------------------------------------------
+void AsyncCallbackBase::Unregister(const Callback& callback)
 {
 	const std::lock_guard<std::mutex> lock(m_lock);
-	
-	// Iterate over list to find callback to remove
-	InvocationNode* curr = m_invocationHead;
-	InvocationNode* prev = NULL;
 
-	const Callback callback(func, thread, userData);
-	while (curr != NULL)
+	InvocationList* list = m_invocationList.get();
+	if (list == NULL)
+		return;
+
+	// Find callback to remove
+	for (size_t slot = 0; slot < list->GetCount(); slot++)
 	{
-		// Is this the callback to remove?
-		if (*curr->CallbackElement == callback)
+		if (!list->GetSlot(slot).Removed.load(std::memory_order_relaxed) &&
+			list->GetSlot(slot).CallbackElement == callback)
 		{
-			if (curr == m_invocationHead)
-				m_invocationHead = curr->Next;
-			else
-				prev->Next = curr->Next;
-			
-			delete curr->CallbackElement;
-			delete curr;
+			RemoveSlot(slot);
+			CompactIfSparse();
 			break;
 		}
-		prev = curr;
-		curr = curr->Next;
-	}	
+	}
+}
+
+//------------------------------------------------------------------------------
+// Unregister
+//------------------------------------------------------------------------------
+bool AsyncCallbackBase::Unregister(CallbackHandle handle)
+{
+	const std::lock_guard<std::mutex> lock(m_lock);
+
+	if (!handle.IsValid() || handle.m_id > m_registrations.size())
+		return false;
+
+	const RegistrationEntry& entry = m_registrations[handle.m_id - 1];
+	if (entry.Slot == INVALID_SLOT || entry.Generation != handle.m_generation)
+		return false;
+
+	RemoveSlot(entry.Slot);
+	CompactIfSparse();
+	return true;
 }
 
 //------------------------------------------------------------------------------
@@ -81,12 +141,118 @@ void AsyncCallbackBase::Clear()
 {
 	const std::lock_guard<std::mutex> lock(m_lock);
 
-	while (m_invocationHead)
+	InvocationList* list = m_invocationList.get();
+	if (list == NULL)
+		return;
+
+	for (size_t slot = 0; slot < list->GetCount(); slot++)
+	{
+		if (!list->GetSlot(slot).Removed.load(std::memory_order_relaxed))
+			RemoveSlot(slot);
+	}
+	CompactIfSparse();
+}
+
+//------------------------------------------------------------------------------
+// RemoveSlot
+//------------------------------------------------------------------------------
+void AsyncCallbackBase::RemoveSlot(size_t slot)
+{
+	InvocationList* list = m_invocationList.get();
+	InvocationSlot& invocationSlot = list->GetSlot(slot);
+	invocationSlot.Removed.store(true, std::memory_order_release);
+
+	// Invalidate outstanding handles and recycle the ID
+	RegistrationEntry& entry = m_registrations[invocationSlot.Id];
+	entry.Slot = INVALID_SLOT;
+	entry.Generation++;
+	SetEpoch(invocationSlot.Id, entry.Generation);
+	m_freeIds.push_back(invocationSlot.Id);
+	m_removedCount++;
+}
+
+//------------------------------------------------------------------------------
+// SetEpoch
+//------------------------------------------------------------------------------
+void AsyncCallbackBase::SetEpoch(UINT32 id, UINT32 generation)
+{
+	const EpochTable* current = m_epochs.load(std::memory_order_relaxed);
+	if (current == NULL || id >= current->Capacity)
 	{
-		InvocationNode* curr = m_invocationHead;
-		m_invocationHead = curr->Next;
-		delete curr->CallbackElement;
-		delete curr;
+		size_t capacity = std::max<size_t>(MIN_CAPACITY, current ? current->Capacity * 2 : 0);
+		while (capacity <= id)
+			capacity *= 2;
+
+		EpochTable* table = new EpochTable(capacity);
+		for (size_t i = 0; i < capacity; i++)
+		{
+			UINT32 epoch = current && i < current->Capacity ? 
+				current->Generations[i].load(std::memory_order_relaxed) : 0;
+			table->Generations[i].store(epoch, std::memory_order_relaxed);
+		}
+		m_epochTables.push_back(std::unique_ptr<EpochTable>(table));
+		m_epochs.store(table, std::memory_order_release);
+		current = table;
 	}
+	current->Generations[id].store(generation, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+// IsRegistered
+//------------------------------------------------------------------------------
+bool AsyncCallbackBase::IsRegistered(const Callback& callback) const
+{
+	CallbackHandle handle = callback.GetHandle();
+	if (!handle.IsValid())
+		return true;
+
+	const EpochTable* table = m_epochs.load(std::memory_order_acquire);
+	UINT32 id = handle.m_id - 1;
+	if (table == NULL || id >= table->Capacity)
+		return true;
+	return table->Generations[id].load(std::memory_order_acquire) == handle.m_generation;
 }
 
+//------------------------------------------------------------------------------
+// CompactIfSparse
+//------------------------------------------------------------------------------
+void AsyncCallbackBase::CompactIfSparse()
+{
+	// Compact once more than half the slots are removed. Removing the last 
+	// registered slot always compacts, leaving no list. 
+	InvocationList* list = m_invocationList.get();
+	if (list != NULL && m_removedCount * 2 > list->GetCount())
+		Compact(0);
+}
+
+//------------------------------------------------------------------------------
+// Compact
+//------------------------------------------------------------------------------
+void AsyncCallbackBase::Compact(size_t capacity)
+{
+	std::shared_ptr<InvocationList> current = m_invocationList;
+	size_t registered = current ? current->GetCount() - m_removedCount : 0;
+
+	std::shared_ptr<InvocationList> list;
+	if (registered != 0 || capacity != 0)
+	{
+		list = std::make_shared<InvocationList>(std::max(capacity, registered));
+		for (size_t slot = 0; current && slot < current->GetCount(); slot++)
+		{
+			const InvocationSlot& invocationSlot = current->GetSlot(slot);
+			if (invocationSlot.Removed.load(std::memory_order_relaxed))
+				continue;
+
+			size_t newSlot = list->GetCount();
+			list->GetSlot(newSlot).CallbackElement = invocationSlot.CallbackElement;
+			list->GetSlot(newSlot).Id = invocationSlot.Id;
+			list->GetSlot(newSlot).Generation = invocationSlot.Generation;
+			list->Append();
+			m_registrations[invocationSlot.Id].Slot = static_cast<UINT32>(newSlot);
+		}
+	}
+	m_removedCount = 0;
+
+	// Invokers holding the previous list keep it alive until they finish
+	std::atomic_store(&m_invocationList, list);
+}
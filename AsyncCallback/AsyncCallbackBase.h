@@ -4,14 +4,19 @@
 #include "Fault.h"
 #include "Callback.h"
 #include "CallbackMsg.h"
+#include "CallbackThread.h"
+#include "CallbackTarget.h"
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 /// @brief A non-template base class for the async callbacks. This class is 
 /// thread-safe.
 /// @details Since the AsyncCallback template class inherits from this class, 
 /// as much code is placed into this base class as possible to minimize the
 /// template code instantiation. 
-class AsyncCallbackBase
+class AsyncCallbackBase : public CallbackTarget
 {
 public:
 	/// Constructor
@@ -20,16 +25,113 @@ public:
 	/// Destructor
 	virtual ~AsyncCallbackBase();
 
-	/// Called to invoke the callback by the destination thread of control. 
-	/// @param[in] msg - the incoming callback message. 
-	virtual void TargetInvoke(CallbackMsg** msg) const = 0;
+	/// Set the overflow policy used when dispatching onto a full callback thread
+	/// queue. Overrides the policy configured on the CallbackThread.
+	/// @param[in] policy - the overflow policy. OVERFLOW_DEFAULT uses the 
+	///		CallbackThread policy. 
+	void SetOverflowPolicy(OverflowPolicy policy) { m_overflowPolicy = policy; }
+
+	/// Set the dispatch policy used when invoked on a callback's target thread.
+	/// Callbacks registered with a policy other than DISPATCH_DEFAULT keep their
+	/// own policy.
+	/// @param[in] policy - the dispatch policy. DISPATCH_DEFAULT is the same
+	///		as DISPATCH_QUEUED. 
+	void SetDispatchPolicy(DispatchPolicy policy) { m_dispatchPolicy = policy; }
+
+	/// Set how long a callback message may wait in a callback thread queue. 
+	/// An expired message is discarded without invoking the callback. 
+	/// @param[in] timeToLiveMs - the time to live in milliseconds. 0 for messages
+	///		that never expire. 
+	void SetTimeToLive(UINT32 timeToLiveMs) { m_timeToLiveMs = timeToLiveMs; }
+
+	/// Get the time to live. 
+	/// @return The time to live in milliseconds or 0 if messages never expire.
+	UINT32 GetTimeToLive() const { return m_timeToLiveMs; }
+
+	/// Enable parallel fan-out for a wide invocation list. When more clients are 
+	/// registered than the threshold, Invoke() forwards half the list to the 
+	/// fan-out thread repeatedly and only dispatches the remainder itself, so 
+	/// the invoker's cost grows with log(clients). Forwarded halves split the 
+	/// same way on the fan-out thread, ideally a WorkerThreadGroup. 
+	/// @details With fan-out, clients on the same thread in different ranges 
+	///		may be called out of registration order, and only clients in the 
+	///		invoker's own range are dispatched inline or deferred. 
+	/// @param[in] thread - the thread forwarding ranges of clients, or NULL to
+	///		disable fan-out. 
+	/// @param[in] threshold - the most clients dispatched by one thread. 
+	void SetFanOut(CallbackThread* thread, UINT32 threshold)
+	{
+		ASSERT_TRUE(thread == NULL || threshold != 0);
+		m_fanOutThreshold = threshold;
+		m_fanOutThread = thread;
+	}
+
+	/// Get the fan-out thread. 
+	/// @return The fan-out thread or NULL if fan-out is disabled. 
+	CallbackThread* GetFanOutThread() const { return m_fanOutThread; }
+
+	/// Get the fan-out threshold. 
+	/// @return The most clients dispatched by one thread. 
+	UINT32 GetFanOutThreshold() const { return m_fanOutThreshold; }
+
+	/// Check if the registration a callback was copied from still exists. Does
+	/// not lock, so a callback thread may check every message cheaply. 
+	/// @param[in] callback - a callback copied from the invocation list.
+	/// @return FALSE if unregistered since the copy was made. TRUE if the 
+	///		callback was never registered. 
+	virtual bool IsRegistered(const Callback& callback) const;
+
+	/// Get the number of callbacks not called because the client unregistered
+	/// after the message was dispatched. 
+	UINT32 GetCancelledCount() const { return m_cancelled; }
 
 protected:
-	struct InvocationNode
+	/// @brief A registered callback. An unregistered slot is marked removed
+	/// instead of erased, so invokers iterating the list are unaffected. 
+	struct InvocationSlot
 	{
-		InvocationNode() : Next(NULL), CallbackElement(NULL) { }
-		InvocationNode* Next;
-		const Callback* CallbackElement;
+		InvocationSlot() : CallbackElement(NULL, NULL), Id(0), Generation(0), Removed(false) {}
+
+		Callback CallbackElement;
+
+		/// Registration ID used to look up the slot by CallbackHandle
+		UINT32 Id;
+
+		/// Distinguishes registrations reusing the same ID
+		UINT32 Generation;
+
+		std::atomic<bool> Removed;
+	};
+
+	/// @brief Contiguous callback storage. Slots below GetCount() are never 
+	/// rewritten, so invokers iterate sequentially without locking while the
+	/// writer appends slots or marks them removed. The writer replaces the 
+	/// list with a compacted copy when full or mostly removed. 
+	class InvocationList
+	{
+	public:
+		InvocationList(size_t capacity) : 
+			m_slots(new InvocationSlot[capacity]), m_capacity(capacity), m_count(0) {}
+
+		/// Get the number of slots published to invokers, including removed slots.
+		size_t GetCount() const { return m_count.load(std::memory_order_acquire); }
+
+		size_t GetCapacity() const { return m_capacity; }
+
+		const InvocationSlot& GetSlot(size_t index) const { return m_slots[index]; }
+		InvocationSlot& GetSlot(size_t index) { return m_slots[index]; }
+
+		/// Publish the slot at GetCount() once written. 
+		/// @pre The list isn't full. 
+		void Append() { m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	private:
+		InvocationList(const InvocationList&) = delete;
+		InvocationList& operator=(const InvocationList&) = delete;
+
+		std::unique_ptr<InvocationSlot[]> m_slots;
+		const size_t m_capacity;
+		std::atomic<size_t> m_count;
 	};
 
 	/// Register for an asynchronous callback. Inserts the into the invocation list.
@@ -39,19 +141,60 @@ protected:
 	///		Callback framework doesn't use userData other than passing it back
 	///		upon CallbackFunc invocation. The userData can point to anything
 	///		or NULL. 
-	void Register(Callback::CallbackFunc func, CallbackThread* thread, void* userData=NULL);
+	/// @param[in] policy - the dispatch policy when invoked on the target thread.
+	/// @param[in] priority - the priority lane for the callback messages. 
+	/// @return A handle to unregister the callback. 
+	CallbackHandle Register(Callback::CallbackFunc func, CallbackThread* thread, void* userData=NULL,
+		DispatchPolicy policy=DISPATCH_DEFAULT, CallbackPriority priority=PRIORITY_NORMAL);
+
+	/// Register a callback, for instance one holding a callable target. 
+	/// @param[in] callback - the callback to insert into the invocation list.
+	/// @return A handle to unregister the callback. 
+	CallbackHandle Register(const Callback& callback);
 
 	/// Unregister from a previously registered callback. 
 	/// @param[in] callback - a callback to unregister. 
 	void Unregister(Callback::CallbackFunc func, CallbackThread* thread, void* userData=NULL);
 
-	/// Get the head of the callback invocation list. 
-	/// @return Pointer to the head of the invocation list. 
-	InvocationNode* GetInvocationHead() { return m_invocationHead; }
+	/// Unregister the first registered callback equal to a callback. 
+	/// @param[in] callback - a callback to unregister. 
+	void Unregister(const Callback& callback);
+
+	/// Unregister a callback in constant time. 
+	/// @param[in] handle - the handle returned by Register().
+	/// @return TRUE if unregistered, FALSE if the handle is no longer registered. 
+	bool Unregister(CallbackHandle handle);
+
+	/// Get the invocation list without locking. Iterate the slots below 
+	/// GetCount() read once, skipping removed slots. The list may be iterated 
+	/// while other threads register or unregister. 
+	/// @return The invocation list or NULL if no callbacks are registered. 
+	std::shared_ptr<const InvocationList> GetInvocationList() const 
+	{ 
+		return std::atomic_load(&m_invocationList); 
+	}
 
-	/// Get the software lock.
-	/// @return The software lock instance.
-	std::mutex& GetLock() { return m_lock; }
+	/// Check a callback about to be called by TargetInvoke(), counting it as 
+	/// cancelled if the client has since unregistered. 
+	/// @param[in] callback - the callback from the message. 
+	/// @return TRUE if the callback must not be called. 
+	bool IsCancelled(const Callback& callback) const
+	{
+		if (IsRegistered(callback))
+			return false;
+		m_cancelled++;
+		return true;
+	}
+
+	/// Get the deadline for messages created now using the time to live. 
+	/// @return The CallbackMsg deadline or 0 if messages never expire. 
+	INT64 GetDeadline() const
+	{
+		UINT32 timeToLiveMs = m_timeToLiveMs;
+		if (timeToLiveMs == 0)
+			return 0;
+		return CallbackMsg::GetTimeNs() + static_cast<INT64>(timeToLiveMs) * 1000000;
+	}
 
 private:
 	// Safe bool idiom
@@ -62,15 +205,72 @@ public:
 		return Empty()? 0 : &AsyncCallbackBase::this_type_does_not_support_comparisons;
     }
 	bool operator !() const { return !Empty(); }
-	bool Empty() const { return !m_invocationHead; }
+	bool Empty() const { return !GetInvocationList(); }
 	void Clear();
 
 private:
-	/// Head pointer to the callback invocation list
-	InvocationNode* m_invocationHead;
+	/// Location of a registration ID in the invocation list
+	struct RegistrationEntry
+	{
+		UINT32 Slot;
+		UINT32 Generation;
+	};
+
+	/// @brief Registration generations indexed by ID, read by IsRegistered()
+	/// without locking. Tables are kept until destruction, so a larger table
+	/// is a copy and a reader of the previous table stays valid. 
+	struct EpochTable
+	{
+		EpochTable(size_t capacity) : Generations(new std::atomic<UINT32>[capacity]), Capacity(capacity) {}
+
+		std::unique_ptr<std::atomic<UINT32>[]> Generations;
+		const size_t Capacity;
+	};
 
-	/// Lock to make the class thead-safe
+	/// Publish the generation of a registration ID, growing the table if needed. 
+	/// @pre m_lock is held. 
+	void SetEpoch(UINT32 id, UINT32 generation);
+
+	/// Mark a slot removed and release its registration ID. 
+	/// @pre m_lock is held. 
+	void RemoveSlot(size_t slot);
+
+	/// Compact the invocation list once most slots are removed. 
+	/// @pre m_lock is held. 
+	void CompactIfSparse();
+
+	/// Replace the invocation list with a copy holding only the registered slots.
+	/// @param[in] capacity - the new list capacity. 0 to size for the registered slots. 
+	/// @pre m_lock is held. 
+	void Compact(size_t capacity);
+
+	/// The callback invocation list. Replaced atomically when compacted. 
+	std::shared_ptr<InvocationList> m_invocationList;
+
+	/// Registration ID table indexed by ID. Guarded by m_lock. 
+	std::vector<RegistrationEntry> m_registrations;
+	std::vector<UINT32> m_freeIds;
+
+	/// The current epoch table and every table allocated. The vector is 
+	/// guarded by m_lock. 
+	std::atomic<const EpochTable*> m_epochs;
+	std::vector<std::unique_ptr<EpochTable>> m_epochTables;
+
+	/// Number of callbacks cancelled by TargetInvoke()
+	mutable std::atomic<UINT32> m_cancelled;
+
+	/// Number of removed slots in the invocation list. Guarded by m_lock. 
+	size_t m_removedCount;
+
+	/// Lock serializing Register(), Unregister() and Clear()
 	std::mutex m_lock;
+
+	/// Callback message time to live or 0 for none
+	std::atomic<UINT32> m_timeToLiveMs;
+
+	/// Fan-out thread or NULL if disabled, and the clients per thread
+	std::atomic<CallbackThread*> m_fanOutThread;
+	std::atomic<UINT32> m_fanOutThreshold;
 };
 
 #endif
@@ -0,0 +1,364 @@
+#ifndef _ASYNC_INVOKE_H
+#define _ASYNC_INVOKE_H
+
+#include "CallbackTarget.h"
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+/// @brief The state of an asynchronous invoke request.
+enum AsyncInvokeStatus
+{
+	/// The function has not executed yet
+	INVOKE_PENDING,
+
+	/// The function executed and the result is available
+	INVOKE_COMPLETED,
+
+	/// The target thread rejected, dropped or expired the request. The
+	/// function never executed.
+	INVOKE_REJECTED
+};
+
+/// @brief The reference counted result shared between a request in flight
+/// and the AsyncResult handles waiting on it.
+template <class TResult>
+class AsyncResultState
+{
+public:
+	/// Constructor. The creator holds the first reference.
+	AsyncResultState() : m_status(INVOKE_PENDING), m_result(), m_refCount(1) { }
+
+	/// Destructor
+	virtual ~AsyncResultState() { }
+
+	/// Add a reference
+	void AddRef() { m_refCount.fetch_add(1, std::memory_order_relaxed); }
+
+	/// Release a reference. The state is deleted when the last reference is
+	/// released.
+	void Release()
+	{
+		if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete this;
+	}
+
+	/// Get the request status without waiting
+	AsyncInvokeStatus GetStatus()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_status;
+	}
+
+	/// Wait for the request to complete or be rejected.
+	/// @param[in] timeoutMs - the maximum wait in milliseconds.
+	/// @return The request status. INVOKE_PENDING if the wait timed out.
+	AsyncInvokeStatus WaitFor(UINT32 timeoutMs)
+	{
+		std::unique_lock<std::mutex> lk(m_lock);
+		m_cv.wait_for(lk, std::chrono::milliseconds(timeoutMs),
+			[this]() { return m_status != INVOKE_PENDING; });
+		return m_status;
+	}
+
+	/// Wait for the request to complete or be rejected.
+	/// @return The request status.
+	AsyncInvokeStatus Wait()
+	{
+		std::unique_lock<std::mutex> lk(m_lock);
+		while (m_status == INVOKE_PENDING)
+			m_cv.wait(lk);
+		return m_status;
+	}
+
+	/// Get the result.
+	/// @pre The status is INVOKE_COMPLETED. The result is never written again.
+	const TResult& GetResult() const { return m_result; }
+
+protected:
+	/// Store the result and release any waiting threads.
+	void SetResult(const TResult& result)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_result = result;
+		m_status = INVOKE_COMPLETED;
+		m_cv.notify_all();
+	}
+
+	/// Mark the request rejected and release any waiting threads.
+	void SetRejected()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_status = INVOKE_REJECTED;
+		m_cv.notify_all();
+	}
+
+private:
+	AsyncResultState(const AsyncResultState&) = delete;
+	AsyncResultState& operator=(const AsyncResultState&) = delete;
+
+	std::mutex m_lock;
+	std::condition_variable m_cv;
+	AsyncInvokeStatus m_status;
+	TResult m_result;
+	std::atomic<int> m_refCount;
+};
+
+/// @brief A future-like handle to the result of AsyncInvoke(). Copies share
+/// the same result.
+template <class TResult>
+class AsyncResult
+{
+public:
+	/// Construct an empty handle
+	AsyncResult() : m_state(NULL) { }
+
+	/// Construct a handle sharing a result state
+	/// @param[in] state - the result state. A reference is added.
+	explicit AsyncResult(AsyncResultState<TResult>* state) : m_state(state)
+	{
+		if (m_state)
+			m_state->AddRef();
+	}
+
+	/// Copy constructor
+	AsyncResult(const AsyncResult& other) : m_state(other.m_state)
+	{
+		if (m_state)
+			m_state->AddRef();
+	}
+
+	/// Assignment operator
+	AsyncResult& operator=(const AsyncResult& other)
+	{
+		if (other.m_state)
+			other.m_state->AddRef();
+		if (m_state)
+			m_state->Release();
+		m_state = other.m_state;
+		return *this;
+	}
+
+	/// Destructor
+	~AsyncResult()
+	{
+		if (m_state)
+			m_state->Release();
+	}
+
+	/// Check if the handle refers to a request
+	bool IsValid() const { return m_state != NULL; }
+
+	/// Get the request status without waiting
+	AsyncInvokeStatus GetStatus() const
+	{
+		ASSERT_TRUE(m_state != NULL);
+		return m_state->GetStatus();
+	}
+
+	/// Wait until the request completes or is rejected.
+	/// @return TRUE if the result is available. FALSE if rejected.
+	bool Wait() const
+	{
+		ASSERT_TRUE(m_state != NULL);
+		return m_state->Wait() == INVOKE_COMPLETED;
+	}
+
+	/// Wait until the request completes, is rejected or the timeout expires.
+	/// @param[in] timeoutMs - the maximum wait in milliseconds.
+	/// @return TRUE if the result is available. FALSE if rejected or timed out.
+	bool WaitFor(UINT32 timeoutMs) const
+	{
+		ASSERT_TRUE(m_state != NULL);
+		return m_state->WaitFor(timeoutMs) == INVOKE_COMPLETED;
+	}
+
+	/// Wait for and get the result.
+	/// @return The value returned by the invoked function.
+	/// @pre The request must not be rejected. Use Wait() to check first.
+	const TResult& Get() const
+	{
+		ASSERT_TRUE(Wait());
+		return m_state->GetResult();
+	}
+
+private:
+	AsyncResultState<TResult>* m_state;
+};
+
+/// @brief A single request to execute a function on a CallbackThread and
+/// return its result. With a completion callback the same message hops 
+/// onward to the completion thread, so a request allocates only itself and
+/// one message.
+/// @details The request is the message target itself rather than a 
+/// registered AsyncCallback. The message holds one reference from dispatch
+/// until the final hop completes or the message is discarded. Each 
+/// AsyncResult holds another.
+template <class TResult, class TArg>
+class AsyncInvokeRequest : public CallbackTarget, public AsyncResultState<TResult>
+{
+public:
+	/// Function executed on the target thread
+	typedef TResult (*InvokeFunc)(const TArg& arg, void* userData);
+
+	/// Function receiving the result on the completion thread
+	typedef void (*CompletionFunc)(const TResult& result, void* userData);
+
+	/// Constructor
+	/// @param[in] func - the function to execute.
+	/// @param[in] thread - the thread to execute the function on.
+	/// @param[in] arg - the function argument. The request stores a copy.
+	/// @param[in] userData - optional user data passed to the function.
+	/// @param[in] priority - the priority lane for the request and completion.
+	AsyncInvokeRequest(InvokeFunc func, CallbackThread* thread, const TArg& arg,
+		void* userData, CallbackPriority priority) :
+		m_arg(arg),
+		m_completionFunc(NULL),
+		m_completionThread(NULL),
+		m_completionUserData(NULL),
+		m_completing(false),
+		m_callback(reinterpret_cast<Callback::CallbackFunc>(func), thread, userData, DISPATCH_QUEUED, priority),
+		m_priority(priority)
+	{
+		ASSERT_TRUE(func != NULL);
+		ASSERT_TRUE(thread != NULL);
+	}
+
+	/// Deliver the result to a function on a completion thread.
+	/// @param[in] func - the completion function.
+	/// @param[in] thread - the thread to call the completion function on.
+	/// @param[in] userData - optional user data passed to the completion function.
+	/// @pre Called before Start().
+	void SetCompletion(CompletionFunc func, CallbackThread* thread, void* userData)
+	{
+		ASSERT_TRUE(func != NULL);
+		ASSERT_TRUE(thread != NULL);
+		m_completionFunc = func;
+		m_completionThread = thread;
+		m_completionUserData = userData;
+	}
+
+	/// Send the request to the target thread. A caller already executing on
+	/// the target thread runs the function before returning, so waiting on
+	/// the result from the target thread never deadlocks.
+	/// @post The message reference is released once the request is done.
+	void Start()
+	{
+		CallbackMsg* msg = new CallbackMsg(this, m_callback, &m_arg, m_priority);
+		CallbackThread* thread = m_callback.GetCallbackThread();
+		if (thread->IsCurrentThread())
+			TargetInvoke(&msg);
+		else
+			thread->DispatchCallback(msg);
+	}
+
+	/// Called by the target thread, and then by the completion thread if any.
+	/// @param[in] msg - the request message. 
+	/// @post The msg object is deleted or redispatched before this function
+	///		returns. 
+	virtual void TargetInvoke(CallbackMsg** msg) const
+	{
+		AsyncInvokeRequest* self = const_cast<AsyncInvokeRequest*>(this);
+		CallbackMsg* requestMsg = *msg;
+		*msg = NULL;
+
+		if (!m_completing)
+		{
+			InvokeFunc func = reinterpret_cast<InvokeFunc>(m_callback.GetCallbackFunction());
+			self->SetResult((*func)(m_arg, m_callback.GetUserData()));
+
+			if (m_completionThread)
+			{
+				// Send the message on to the completion thread. Neither the 
+				// request nor the message may be touched once dispatched.
+				self->m_completing = true;
+				requestMsg->SetCallback(Callback(reinterpret_cast<Callback::CallbackFunc>(m_completionFunc), 
+					m_completionThread, m_completionUserData, DISPATCH_QUEUED, m_priority));
+				m_completionThread->DispatchCallback(requestMsg);
+				return;
+			}
+		}
+		else
+		{
+			(*m_completionFunc)(this->GetResult(), m_completionUserData);
+		}
+		delete requestMsg;
+		self->Release();
+	}
+
+	/// Called when a thread rejects, drops or expires the message.
+	/// @param[in] msg - the request message.
+	/// @post The msg object is deleted before this function returns. 
+	virtual void TargetDiscard(CallbackMsg** msg) const
+	{
+		AsyncInvokeRequest* self = const_cast<AsyncInvokeRequest*>(this);
+		delete *msg;
+		*msg = NULL;
+
+		// A discarded completion hop leaves the result available to waiters
+		if (!m_completing)
+			self->SetRejected();
+		self->Release();
+	}
+
+private:
+	const TArg m_arg;
+	CompletionFunc m_completionFunc;
+	CallbackThread* m_completionThread;
+	void* m_completionUserData;
+
+	/// TRUE once the function has executed and the message is headed to the
+	/// completion thread. Only accessed by the thread holding the message.
+	bool m_completing;
+
+	/// The function executed on the target thread
+	const Callback m_callback;
+	const CallbackPriority m_priority;
+};
+
+/// Execute a function on a CallbackThread and return its result.
+/// @param[in] func - the function to execute on the target thread.
+/// @param[in] thread - the target thread.
+/// @param[in] arg - the function argument. Copied into the request.
+/// @param[in] userData - optional user data passed to the function.
+/// @param[in] priority - the priority lane for the request.
+/// @return A handle to wait on the result.
+template <class TResult, class TArg>
+AsyncResult<TResult> AsyncInvoke(TResult (*func)(const TArg&, void*), CallbackThread* thread,
+	const TArg& arg, void* userData = NULL, CallbackPriority priority = PRIORITY_NORMAL)
+{
+	AsyncInvokeRequest<TResult, TArg>* request =
+		new AsyncInvokeRequest<TResult, TArg>(func, thread, arg, userData, priority);
+	AsyncResult<TResult> result(request);
+	request->Start();
+	return result;
+}
+
+/// Execute a function on a CallbackThread and call a completion function
+/// with the result on another CallbackThread.
+/// @param[in] func - the function to execute on the target thread.
+/// @param[in] thread - the target thread.
+/// @param[in] arg - the function argument. Copied into the request.
+/// @param[in] userData - optional user data passed to the function.
+/// @param[in] completion - the function receiving the result.
+/// @param[in] completionThread - the thread to call the completion function on.
+/// @param[in] completionUserData - optional user data passed to the completion
+///		function.
+/// @param[in] priority - the priority lane for the request and completion.
+/// @return A handle to wait on the result. May be ignored.
+template <class TResult, class TArg>
+AsyncResult<TResult> AsyncInvoke(TResult (*func)(const TArg&, void*), CallbackThread* thread,
+	const TArg& arg, void* userData, void (*completion)(const TResult&, void*),
+	CallbackThread* completionThread, void* completionUserData = NULL,
+	CallbackPriority priority = PRIORITY_NORMAL)
+{
+	AsyncInvokeRequest<TResult, TArg>* request =
+		new AsyncInvokeRequest<TResult, TArg>(func, thread, arg, userData, priority);
+	request->SetCompletion(completion, completionThread, completionUserData);
+	AsyncResult<TResult> result(request);
+	request->Start();
+	return result;
+}
+
+#endif
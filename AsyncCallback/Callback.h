@@ -2,9 +2,67 @@
 #define _CALLBACK_H
 
 #include "DataTypes.h"
+#include <type_traits>
+#include <cstring>
 
 class CallbackThread;
 
+/// @brief The priority lane a callback message is queued in. A CallbackThread
+/// delivers higher priority messages ahead of lower priority messages. 
+enum CallbackPriority
+{
+	PRIORITY_HIGH,
+	PRIORITY_NORMAL,
+	PRIORITY_LOW,
+	PRIORITY_LANES
+};
+
+/// @brief How a callback is delivered when AsyncCallback::Invoke() is called
+/// on the callback's target thread. Callbacks invoked from any other thread 
+/// are always queued.
+enum DispatchPolicy
+{
+	/// Use the policy configured on the AsyncCallback
+	DISPATCH_DEFAULT,
+
+	/// Queue the callback message onto the target thread
+	DISPATCH_QUEUED,
+
+	/// Call the callback function immediately within Invoke(). The callback
+	/// runs nested inside the invoking code, so it must not rely on 
+	/// run-to-completion of the caller. 
+	DISPATCH_INLINE,
+
+	/// Hold the callback on the target thread and call it once the current
+	/// message completes, ahead of the next queued message.
+	DISPATCH_DEFERRED
+};
+
+/// @brief Identifies one registration returned by AsyncCallback::Register(). 
+/// Unregistering by handle takes constant time. A handle is invalid once 
+/// unregistered, even if the same callback is registered again. 
+class CallbackHandle
+{
+public:
+	/// Constructs an invalid handle
+	CallbackHandle() : m_id(0), m_generation(0) {}
+
+	/// Check if the handle refers to a registration. 
+	/// @return TRUE if returned by Register(). 
+	bool IsValid() const { return m_id != 0; }
+
+private:
+	friend class AsyncCallbackBase;
+
+	CallbackHandle(UINT32 id, UINT32 generation) : m_id(id), m_generation(generation) {}
+
+	/// Registration ID plus one, or 0 for an invalid handle
+	UINT32 m_id;
+
+	/// Distinguishes reuses of the same registration ID
+	UINT32 m_generation;
+};
+
 /// @brief Callback stores information about a registered callback client. 
 class Callback
 {
@@ -12,6 +70,10 @@ public:
 	/// Generic callback function signature
 	typedef void (*CallbackFunc)(const void* cbData, void* userData);
 
+	/// Inline storage size for a callable target. Fits a pointer to member 
+	/// function bound to an object. 
+	static const size_t CALLABLE_SIZE = 4 * sizeof(void*);
+
 	/// Constructor
 	/// @param[in] func - the target callback function.
 	/// @param[in] thread - target thread to execute the asynchronous callback.
@@ -19,13 +81,51 @@ public:
 	///		Callback framework doesn't use userData other than passing it back
 	///		upon CallbackFunc invocation. The userData can point to anything
 	///		or NULL. 
-	Callback(CallbackFunc func, CallbackThread* thread, void* userData = NULL) :
+	/// @param[in] policy - same thread dispatch policy. 
+	/// @param[in] priority - the priority lane for callback messages. 
+	Callback(CallbackFunc func, CallbackThread* thread, void* userData = NULL, 
+		DispatchPolicy policy = DISPATCH_DEFAULT, CallbackPriority priority = PRIORITY_NORMAL) :
 		m_thread(thread),
+		m_userData(userData),
 		m_func(func),
-		m_userData(userData)
+		m_policy(policy),
+		m_priority(priority),
+		m_callable(false),
+		m_comparable(false)
 	{
 	}
 
+	/// Store a callable target, such as a lambda, in the callback. The function
+	/// passed to the constructor is then called with the stored callable as 
+	/// its user data argument. A callback holding a callable never compares
+	/// equal to another, because the callable's padding bytes are 
+	/// indeterminate. Unregister such a callback by handle. 
+	/// @param[in] callable - a trivially copyable callable no larger than
+	///		CALLABLE_SIZE. Copied into the callback without heap allocation.
+	/// @param[in] comparable - TRUE if TCallable has no padding, so callbacks
+	///		holding the same callable bytes compare equal. Used by adapters 
+	///		storing a function and user data. 
+	template <class TCallable>
+	void SetCallable(const TCallable& callable, bool comparable = false)
+	{
+		static_assert(sizeof(TCallable) <= CALLABLE_SIZE, "Callable too large for inline storage");
+		static_assert(alignof(TCallable) <= alignof(void*), "Callable alignment not supported");
+		static_assert(std::is_trivially_copyable<TCallable>::value && std::is_trivially_destructible<TCallable>::value,
+			"Callable must be trivially copyable, e.g. a lambda capturing pointers and values");
+
+		std::memset(m_storage, 0, sizeof(m_storage));
+		std::memcpy(m_storage, &callable, sizeof(TCallable));
+		m_callable = true;
+		m_comparable = comparable;
+	}
+
+	/// Get the argument passed as the callback function user data. 
+	/// @return The stored callable, if any, otherwise the user data.
+	void* GetCallbackArgument() const
+	{
+		return m_callable ? const_cast<void*>(static_cast<const void*>(m_storage)) : m_userData;
+	}
+
 	/// Get the thread instance
 	/// @return The thread instance to invoke the callback. 
 	CallbackThread* GetCallbackThread() const
@@ -48,11 +148,38 @@ public:
 		return m_func;
 	}	
 
+	/// Get the same thread dispatch policy.
+	/// @return The dispatch policy. DISPATCH_DEFAULT uses the AsyncCallback policy.
+	DispatchPolicy GetDispatchPolicy() const
+	{
+		return m_policy;
+	}
+
+	/// Get the priority lane for callback messages. 
+	/// @return The callback priority. 
+	CallbackPriority GetPriority() const
+	{
+		return m_priority;
+	}
+
+	/// Get the registration the callback was copied from. 
+	/// @return The registration handle, or an invalid handle if the callback
+	///		was never registered. 
+	CallbackHandle GetHandle() const
+	{
+		return m_handle;
+	}
+
+	/// Compare the function, thread and user data. A stored callable is only 
+	/// compared if it was stored as comparable. 
 	bool operator==(const Callback& rhs) const
 	{
 		return m_thread == rhs.m_thread &&
 			m_func == rhs.m_func &&
-			m_userData == rhs.m_userData;
+			m_userData == rhs.m_userData &&
+			m_callable == rhs.m_callable &&
+			(!m_callable || (m_comparable && rhs.m_comparable && 
+				std::memcmp(m_storage, rhs.m_storage, sizeof(m_storage)) == 0));
 	}
 
 	bool operator!=(const Callback& rhs) const
@@ -61,6 +188,8 @@ public:
 	}
 
 private:
+	friend class AsyncCallbackBase;
+
 	/// Pointer to the thread the callback is to be invoked from.
 	CallbackThread* m_thread;
 
@@ -71,6 +200,24 @@ private:
 	/// to a AsyncCallback::CallbackFunc type before invoking the 
 	/// function callback
 	CallbackFunc m_func;
+
+	/// Same thread dispatch policy. Not used to compare callbacks.
+	DispatchPolicy m_policy;
+
+	/// Priority lane. Not used to compare callbacks.
+	CallbackPriority m_priority;
+
+	/// TRUE if m_storage holds a callable target
+	bool m_callable;
+
+	/// TRUE if the callable has no padding and is compared by value
+	bool m_comparable;
+
+	/// Registration set by AsyncCallbackBase. Not used to compare callbacks.
+	CallbackHandle m_handle;
+
+	/// Inline callable storage. Unused bytes are zero.
+	alignas(void*) unsigned char m_storage[CALLABLE_SIZE];
 };
 
 #endif
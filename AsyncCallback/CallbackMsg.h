@@ -3,9 +3,27 @@
 
 #include "DataTypes.h"
 #include "Fault.h"
+#include "Callback.h"
+#include <chrono>
 
-class Callback;
-class AsyncCallbackBase;
+class CallbackTarget;
+
+/// @brief What a CallbackMsg delivers. Set by the AsyncCallback creating the
+/// message and interpreted by its TargetInvoke(). 
+enum DeliveryKind
+{
+	/// The message callback is called with the callback data
+	DELIVERY_SINGLE,
+
+	/// Several callbacks on the message thread are called in order
+	DELIVERY_GROUP,
+
+	/// Several callbacks are called with a batch of items
+	DELIVERY_BATCH,
+
+	/// A range of the invocation list is forwarded or dispatched
+	DELIVERY_FAN_OUT
+};
 
 /// @brief A class containing the callback information passed through 
 /// the message queue. 
@@ -13,23 +31,29 @@ class CallbackMsg
 {
 public:
 	/// Constructor
-	/// @param[in] asyncCallback - the async callback instance the callback is registered
-	///		with.
-	/// @param[in] callback - the callback instance. 
+	/// @param[in] asyncCallback - the target the message is delivered to, usually
+	///		the async callback instance the callback is registered with.
+	/// @param[in] callback - the callback instance. The message stores a copy.
 	/// @param[in] callbackData - the data sent as callback function argument.
-	CallbackMsg(AsyncCallbackBase* asyncCallback, const Callback* callback, const void* callbackData) :
+	/// @param[in] priority - the priority lane to queue the message in. 
+	/// @param[in] kind - what the message delivers. 
+	CallbackMsg(CallbackTarget* asyncCallback, const Callback& callback, const void* callbackData,
+		CallbackPriority priority = PRIORITY_NORMAL, DeliveryKind kind = DELIVERY_SINGLE) :
 		m_asyncCallback(asyncCallback),
 	  	m_callback(callback),
-		m_callbackData(callbackData)
+		m_callbackData(callbackData),
+		m_priority(priority),
+		m_kind(kind),
+		m_deadlineNs(0)
 	{
+		ASSERT_TRUE(m_priority < PRIORITY_LANES);
 		ASSERT_TRUE(m_asyncCallback != NULL);
-		ASSERT_TRUE(m_callback != NULL);
 		ASSERT_TRUE(m_callbackData != NULL);
 	}
 
-	/// Get the async callback instance the callback is registered with.
-	/// @return The async callback instance. 
-	const AsyncCallbackBase* GetAsyncCallback() const
+	/// Get the target the message is delivered to.
+	/// @return The async callback instance or other message target. 
+	const CallbackTarget* GetAsyncCallback() const
 	{
 		return m_asyncCallback;
 	}
@@ -38,7 +62,15 @@ public:
 	/// @return The callback instance. 
 	const Callback* GetCallback() const
 	{
-		return m_callback;
+		return &m_callback;
+	}
+
+	/// Point the message at another callback, so a request continuing on a 
+	/// second thread redispatches its message instead of allocating another.
+	/// @param[in] callback - the next callback. The message stores a copy.
+	void SetCallback(const Callback& callback)
+	{
+		m_callback = callback;
 	}
 
 	/// Get the callback data passed into the callback function. 
@@ -48,15 +80,68 @@ public:
 		return m_callbackData;
 	}
 
+	/// Get the priority lane to queue the message in. 
+	/// @return The message priority. 
+	CallbackPriority GetPriority() const
+	{
+		return m_priority;
+	}
+
+	/// Get what the message delivers. 
+	/// @return The delivery kind. 
+	DeliveryKind GetKind() const
+	{
+		return m_kind;
+	}
+
+	/// Set the time after which the callback is discarded instead of invoked.
+	/// @param[in] deadlineNs - the GetTimeNs() deadline or 0 for no deadline. 
+	void SetDeadline(INT64 deadlineNs)
+	{
+		m_deadlineNs = deadlineNs;
+	}
+
+	/// Get the deadline. 
+	/// @return The GetTimeNs() deadline or 0 if the message never expires. 
+	INT64 GetDeadline() const
+	{
+		return m_deadlineNs;
+	}
+
+	/// Check if the message deadline has passed. Only reads the clock when a 
+	/// deadline is set. 
+	/// @return TRUE if the message is expired. 
+	bool IsExpired() const
+	{
+		return m_deadlineNs != 0 && GetTimeNs() >= m_deadlineNs;
+	}
+
+	/// Get the monotonic time used for message deadlines. 
+	/// @return The steady clock time in nanoseconds. 
+	static INT64 GetTimeNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
 private:
-	/// The AsyncCallback instance
-	AsyncCallbackBase* m_asyncCallback;
+	/// The AsyncCallback instance or other message target
+	CallbackTarget* m_asyncCallback;
 
 	/// The callback instance
-	const Callback* m_callback;
+	Callback m_callback;
 
 	/// The data argument passed into the callback function
 	const void* m_callbackData;
+
+	/// The priority lane
+	CallbackPriority m_priority;
+
+	/// What the message delivers
+	DeliveryKind m_kind;
+
+	/// Expiry deadline in nanoseconds or 0 for none
+	INT64 m_deadlineNs;
 };
 
 #endif
\ No newline at end of file
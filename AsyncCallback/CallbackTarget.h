@@ -0,0 +1,77 @@
+#ifndef _CALLBACK_TARGET_H
+#define _CALLBACK_TARGET_H
+
+#include "Callback.h"
+#include "CallbackMsg.h"
+#include "CallbackThread.h"
+#include <atomic>
+
+/// @brief The receiver of a CallbackMsg. A CallbackThread runs or discards
+/// each message through this interface.
+/// @details AsyncCallbackBase implements it for registered callbacks. One-shot
+/// senders, such as AsyncInvokeRequest, implement it directly without an
+/// invocation list.
+class CallbackTarget
+{
+public:
+	/// Constructor
+	CallbackTarget() :
+		m_overflowPolicy(OVERFLOW_DEFAULT),
+		m_dispatchPolicy(DISPATCH_QUEUED)
+	{
+	}
+
+	/// Destructor
+	virtual ~CallbackTarget() {}
+
+	/// Called to invoke the callback by the destination thread of control.
+	/// @param[in] msg - the incoming callback message.
+	virtual void TargetInvoke(CallbackMsg** msg) const = 0;
+
+	/// Called to delete a callback message without invoking the callback. Used
+	/// by a CallbackThread when a message is dropped or rejected.
+	/// @param[in] msg - the callback message to delete.
+	virtual void TargetDiscard(CallbackMsg** msg) const = 0;
+
+	/// Get the overflow policy.
+	/// @return The overflow policy.
+	OverflowPolicy GetOverflowPolicy() const { return m_overflowPolicy; }
+
+	/// Get the dispatch policy that applies to a callback.
+	/// @param[in] callback - a message callback.
+	/// @return The callback's own policy, if any, otherwise the target's
+	///		default policy.
+	DispatchPolicy GetDispatchPolicy(const Callback& callback) const
+	{
+		DispatchPolicy policy = callback.GetDispatchPolicy();
+		return policy != DISPATCH_DEFAULT ? policy : m_dispatchPolicy.load();
+	}
+
+	/// Check if the registration a callback was copied from still exists.
+	/// @param[in] callback - a message callback.
+	/// @return FALSE if the message should be discarded unread.
+	virtual bool IsRegistered(const Callback& /*callback*/) const { return true; }
+
+	/// Get the function a callback ultimately calls, for diagnostics such as
+	/// heartbeats and CPU accounting.
+	/// @param[in] callback - a message callback.
+	/// @return The client's function. Differs from GetCallbackFunction() when
+	///		the client function is called through an adapter.
+	virtual Callback::CallbackFunc GetTargetFunction(const Callback& callback) const
+	{
+		return callback.GetCallbackFunction();
+	}
+
+protected:
+	/// Overflow policy applied to all callback messages
+	std::atomic<OverflowPolicy> m_overflowPolicy;
+
+	/// Dispatch policy for callbacks registered with DISPATCH_DEFAULT
+	std::atomic<DispatchPolicy> m_dispatchPolicy;
+
+private:
+	CallbackTarget(const CallbackTarget&) = delete;
+	CallbackTarget& operator=(const CallbackTarget&) = delete;
+};
+
+#endif
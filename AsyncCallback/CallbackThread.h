@@ -4,6 +4,26 @@
 #include "DataTypes.h"
 #include "CallbackMsg.h"
 
+/// @brief The action a CallbackThread takes when a message is dispatched
+/// while its queue is full.
+enum OverflowPolicy
+{
+	/// Use the policy configured on the CallbackThread
+	OVERFLOW_DEFAULT,
+
+	/// Block the dispatching thread until space is available
+	OVERFLOW_BLOCK,
+
+	/// Reject the new message. DispatchCallback() returns false.
+	OVERFLOW_FAIL,
+
+	/// Discard the oldest queued message to make room for the new message
+	OVERFLOW_DROP_OLDEST,
+
+	/// Discard the new message. DispatchCallback() returns false.
+	OVERFLOW_DROP_NEWEST
+};
+
 /// @brief Each platform specific implementation must inherit from CallbackThread
 /// and provide an implementation for DispatchCallback().
 class CallbackThread
@@ -15,12 +35,51 @@ public:
 	/// Dispatch a CallbackMsg onto this thread. The implementer is responsible
 	/// for getting the CallbackMsg into an OS message queue. Once CallbackMsg
 	/// is on the correct thread of control, the AysncCallbackBase::TargetInvoke() function
-	/// must be called to execute the callback. 
+	/// must be called to execute the callback.
 	/// @param[in] msg - a pointer to the callback message that must be created dynamically
-	///		using operator new. 
+	///		using operator new.
+	/// @return TRUE if the message was queued. FALSE if the message was rejected
+	///		or dropped because the queue is full.
 	/// @pre Caller *must* create the CallbackMsg argument dynamically using operator new.
 	/// @post The destination thread must delete the msg instance by calling TargetInvoke().
-	virtual void DispatchCallback(CallbackMsg* msg) = 0;
+	///		A message that is rejected or dropped is deleted by calling
+	///		AsyncCallbackBase::TargetDiscard() instead.
+	virtual bool DispatchCallback(CallbackMsg* msg) = 0;
+
+	/// Check if the caller is executing on this thread. Used to apply the 
+	/// DISPATCH_INLINE and DISPATCH_DEFERRED policies. 
+	/// @return TRUE if called from this thread of control. 
+	virtual bool IsCurrentThread() const { return false; }
+
+	/// Check if several threads consume this thread's messages in parallel. 
+	/// AsyncCallback then sends each queued callback its own message instead
+	/// of grouping callbacks per thread. 
+	/// @return TRUE if messages may run concurrently. 
+	virtual bool IsMultiConsumer() const { return false; }
+
+	/// Check if this thread transports callback data by copying it directly, 
+	/// for instance into shared memory read by another process. AsyncCallback
+	/// then calls DispatchData() for trivially copyable data instead of creating
+	/// a CallbackMsg, so the data is copied exactly once. 
+	/// @return TRUE if DispatchData() is implemented. 
+	virtual bool IsCopyTransport() const { return false; }
+
+	/// Copy callback data into the transport. 
+	/// @param[in] callback - the registered callback. 
+	/// @param[in] data - the callback data. Not referenced after returning. 
+	/// @param[in] size - the callback data size in bytes. 
+	/// @return TRUE if the data was queued. FALSE if rejected. 
+	virtual bool DispatchData(const Callback& /*callback*/, const void* /*data*/, size_t /*size*/) { return false; }
+
+	/// Called on this thread before each callback of a message delivering 
+	/// several callbacks, so diagnostics credit the client function running 
+	/// rather than the whole message. 
+	/// @param[in] func - the client function. 
+	/// @param[in] userData - the client user data. 
+	virtual void BeginCallback(Callback::CallbackFunc /*func*/, void* /*userData*/) {}
+
+	/// Called on this thread after each callback passed to BeginCallback(). 
+	virtual void EndCallback() {}
 };
 
 #endif
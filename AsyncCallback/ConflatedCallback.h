@@ -0,0 +1,245 @@
+#ifndef _CONFLATED_CALLBACK_H
+#define _CONFLATED_CALLBACK_H
+
+#include "AsyncCallback.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+/// @brief A latest-value variant of AsyncCallback for telemetry, such as status
+/// updates rendered by a user interface. Each registered client has at most
+/// one callback message queued. Invoking while a client's message is still
+/// queued overwrites the pending data in place instead of queuing again, so
+/// the client receives only the newest value. Memory use and queue length
+/// stay constant at any invoke rate. This class is thread-safe.
+/// @details TData must be copy assignable. A DISPATCH_INLINE callback invoked
+/// on its own target thread is called directly. Callbacks are never grouped
+/// and copy transports are not used.
+template<typename TData = NoData>
+class ConflatedCallback : public AsyncCallbackBase
+{
+public:
+	/// Callback function signature
+	typedef void (*CallbackFunc)(const TData& cbData, void* userData);
+
+	/// Constructor
+	ConflatedCallback() : m_overwriteCount(0), m_deliveredCount(0) {}
+
+	/// Destructor
+	~ConflatedCallback()
+	{
+		for (size_t i = 0; i < m_pending.size(); i++)
+			delete m_pending[i];
+	}
+
+	/// @see AsyncCallbackBase::Register
+	CallbackHandle Register(CallbackFunc func, CallbackThread* thread, void* userData=NULL,
+		DispatchPolicy policy=DISPATCH_DEFAULT, CallbackPriority priority=PRIORITY_NORMAL)
+	{
+		return AsyncCallbackBase::Register(reinterpret_cast<Callback::CallbackFunc>(func), thread, userData,
+			policy, priority);
+	}
+
+	/// @see AsyncCallbackBase::Unregister
+	void Unregister(CallbackFunc func, CallbackThread* thread, void* userData=NULL)
+	{
+		AsyncCallbackBase::Unregister(reinterpret_cast<Callback::CallbackFunc>(func), thread, userData);
+	}
+
+	/// @see AsyncCallbackBase::Unregister
+	bool Unregister(CallbackHandle handle)
+	{
+		return AsyncCallbackBase::Unregister(handle);
+	}
+
+	/// @see Invoke
+	bool operator()(const TData& data)
+	{
+		return Invoke(data);
+	}
+
+	/// Called to invoke callbacks on all registered clients. A client with a
+	/// message already queued has its pending data overwritten.
+	/// @param[in] data - the data to pass to each client callback function
+	///		argument.
+	/// @return TRUE if the callback was dispatched or conflated for every
+	///		registered client. FALSE if any callback thread rejected or dropped
+	///		the message.
+	bool Invoke(const TData& data)
+	{
+		std::shared_ptr<const InvocationList> list = GetInvocationList();
+		if (!list)
+			return true;
+
+		bool dispatched = true;
+		const INT64 deadlineNs = GetDeadline();
+
+		// Callbacks run and messages are dispatched after unlocking, since a
+		// callback may invoke again and a full queue may block
+		std::vector<const Callback*> inlineCallbacks;
+		std::vector<CallbackMsg*> msgs;
+		{
+			const std::lock_guard<std::mutex> lock(m_pendingLock);
+
+			const size_t count = list->GetCount();
+			for (size_t slot = 0; slot < count; slot++)
+			{
+				const InvocationSlot& invocationSlot = list->GetSlot(slot);
+				if (invocationSlot.Removed.load(std::memory_order_acquire))
+					continue;
+
+				const Callback* callback = &invocationSlot.CallbackElement;
+
+				// Already executing on the target thread? Call the callback function
+				// directly without creating a message.
+				if (GetDispatchPolicy(*callback) == DISPATCH_INLINE &&
+					callback->GetCallbackThread()->IsCurrentThread())
+				{
+					inlineCallbacks.push_back(callback);
+					continue;
+				}
+
+				PendingEntry* entry = GetEntry(invocationSlot.Id, invocationSlot.Generation);
+				if (entry->Data == NULL)
+					entry->Data = new TData(data);
+				else
+					*entry->Data = data;
+
+				// Message still queued? It delivers the new data.
+				if (entry->Pending)
+				{
+					m_overwriteCount.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+
+				entry->Pending = true;
+				CallbackMsg* msg = new CallbackMsg(this, *callback, entry, callback->GetPriority());
+				msg->SetDeadline(deadlineNs);
+				msgs.push_back(msg);
+			}
+		}
+
+		for (size_t i = 0; i < inlineCallbacks.size(); i++)
+		{
+			CallbackFunc func = reinterpret_cast<CallbackFunc>(inlineCallbacks[i]->GetCallbackFunction());
+			(*func)(data, inlineCallbacks[i]->GetCallbackArgument());
+		}
+
+		for (size_t i = 0; i < msgs.size(); i++)
+		{
+			if (!msgs[i]->GetCallback()->GetCallbackThread()->DispatchCallback(msgs[i]))
+				dispatched = false;
+		}
+		return dispatched;
+	}
+
+	/// Called from the destination callback thread of control.
+	/// @param[in] msg - the incoming callback message.
+	/// @post The msg object is deleted before this function returns.
+	virtual void TargetInvoke(CallbackMsg** msg) const
+	{
+		const Callback* callback = (*msg)->GetCallback();
+		PendingEntry* entry = static_cast<PendingEntry*>(const_cast<void*>((*msg)->GetCallbackData()));
+
+		// Client unregistered after the message was dispatched?
+		if (IsCancelled(*callback))
+		{
+			TargetDiscard(msg);
+			return;
+		}
+
+		// Take the newest data. Later invokes queue a new message.
+		std::unique_lock<std::mutex> lock(m_pendingLock);
+		TData data(*entry->Data);
+		Release(entry);
+		lock.unlock();
+
+		m_deliveredCount.fetch_add(1, std::memory_order_relaxed);
+
+		CallbackFunc func = reinterpret_cast<CallbackFunc>(callback->GetCallbackFunction());
+		(*func)(data, callback->GetCallbackArgument());
+
+		delete *msg;
+		*msg = NULL;
+	}
+
+	/// Called by the callback thread to delete a message that is not invoked.
+	/// @param[in] msg - the callback message to delete.
+	/// @post The msg object is deleted before this function returns.
+	virtual void TargetDiscard(CallbackMsg** msg) const
+	{
+		PendingEntry* entry = static_cast<PendingEntry*>(const_cast<void*>((*msg)->GetCallbackData()));
+		{
+			const std::lock_guard<std::mutex> lock(m_pendingLock);
+			Release(entry);
+		}
+		delete *msg;
+		*msg = NULL;
+	}
+
+	/// Get the number of times pending data was overwritten by a newer invoke.
+	/// May be called from any thread.
+	UINT64 GetOverwriteCount() const { return m_overwriteCount.load(std::memory_order_relaxed); }
+
+	/// Get the number of callbacks delivered. May be called from any thread.
+	UINT64 GetDeliveredCount() const { return m_deliveredCount.load(std::memory_order_relaxed); }
+
+private:
+	/// @brief The latest data for one registration. Pending while a message
+	/// referring to the entry is queued. Entries are reused by later
+	/// registrations with the same ID.
+	struct PendingEntry
+	{
+		PendingEntry(UINT32 id, UINT32 generation) :
+			Id(id), Generation(generation), Pending(false), Data(NULL) {}
+		~PendingEntry() { delete Data; }
+
+		UINT32 Id;
+		UINT32 Generation;
+		bool Pending;
+		TData* Data;
+	};
+
+	/// Get the entry for a registration.
+	/// @pre m_pendingLock is held.
+	PendingEntry* GetEntry(UINT32 id, UINT32 generation)
+	{
+		if (id >= m_pending.size())
+			m_pending.resize(id + 1, NULL);
+
+		PendingEntry*& entry = m_pending[id];
+		if (entry == NULL)
+		{
+			entry = new PendingEntry(id, generation);
+		}
+		else if (entry->Generation != generation)
+		{
+			// The ID was reused. A message still queued for the earlier
+			// registration keeps its entry until delivered.
+			if (entry->Pending)
+				entry = new PendingEntry(id, generation);
+			else
+				entry->Generation = generation;
+		}
+		return entry;
+	}
+
+	/// Clear the pending flag once the entry's message is delivered or
+	/// discarded, deleting an entry replaced by a later registration.
+	/// @pre m_pendingLock is held.
+	void Release(PendingEntry* entry) const
+	{
+		entry->Pending = false;
+		if (m_pending[entry->Id] != entry)
+			delete entry;
+	}
+
+	/// Pending entries indexed by registration ID. Guarded by m_pendingLock.
+	std::vector<PendingEntry*> m_pending;
+	mutable std::mutex m_pendingLock;
+
+	std::atomic<UINT64> m_overwriteCount;
+	mutable std::atomic<UINT64> m_deliveredCount;
+};
+
+#endif
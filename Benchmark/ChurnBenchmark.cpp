@@ -0,0 +1,115 @@
+// Measures AsyncCallback::Invoke() throughput from several invoking threads
+// while another thread registers and unregisters callbacks. Callbacks run on
+// the invoking thread through a CallbackThread that invokes each message as
+// it is dispatched, so the figures measure the invocation list and message
+// handling rather than a worker thread queue.
+//
+// Usage: ChurnBenchmark [invokers] [subscribers] [seconds]
+
+#include "AsyncCallback.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+//----------------------------------------------------------------------------
+// CallerThread - invokes each callback message on the dispatching thread
+//----------------------------------------------------------------------------
+class CallerThread : public CallbackThread
+{
+public:
+	virtual bool DispatchCallback(CallbackMsg* msg)
+	{
+		msg->GetAsyncCallback()->TargetInvoke(&msg);
+		return true;
+	}
+};
+
+static atomic<UINT64> calls(0);
+
+//----------------------------------------------------------------------------
+// Subscriber
+//----------------------------------------------------------------------------
+static void Subscriber(const int& /*data*/, void* /*userData*/)
+{
+	calls.fetch_add(1, memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// Run - invoke from several threads for a duration, optionally with churn
+//----------------------------------------------------------------------------
+static void Run(int invokers, int subscribers, double runSeconds, bool churn)
+{
+	// Each subscriber on its own thread object so no messages are grouped
+	vector<CallerThread> threads(subscribers + 1);
+	AsyncCallback<int> callback;
+	for (int i = 0; i < subscribers; i++)
+		callback.Register(&Subscriber, &threads[i]);
+
+	atomic<bool> stop(false);
+	atomic<UINT64> invokes(0);
+	UINT64 churnOps = 0;
+	calls = 0;
+
+	vector<thread> invokerThreads;
+	for (int t = 0; t < invokers; t++)
+	{
+		invokerThreads.emplace_back([&]() {
+			UINT64 count = 0;
+			while (!stop.load(memory_order_relaxed))
+			{
+				callback(1);
+				count++;
+			}
+			invokes += count;
+		});
+	}
+
+	// Register and unregister one extra callback as fast as possible. Each
+	// pair appends a slot and removes it, so the list is regularly compacted.
+	thread churnThread;
+	if (churn)
+	{
+		churnThread = thread([&]() {
+			while (!stop.load(memory_order_relaxed))
+			{
+				callback.Register(&Subscriber, &threads[subscribers]);
+				callback.Unregister(&Subscriber, &threads[subscribers]);
+				churnOps++;
+			}
+		});
+	}
+
+	this_thread::sleep_for(duration<double>(runSeconds));
+	stop = true;
+	for (size_t t = 0; t < invokerThreads.size(); t++)
+		invokerThreads[t].join();
+	if (churnThread.joinable())
+		churnThread.join();
+
+	printf("%2d invokers  %4d subscribers  churn %-3s  %8.3f M invokes/s  %8.3f M calls/s  %8.3f M register+unregister/s\n",
+		invokers, subscribers, churn ? "on" : "off", invokes / runSeconds / 1e6, calls / runSeconds / 1e6,
+		churnOps / runSeconds / 1e6);
+}
+
+//----------------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	int invokers = argc > 1 ? atoi(argv[1]) : 4;
+	int subscribers = argc > 2 ? atoi(argv[2]) : 8;
+	double runSeconds = argc > 3 ? atof(argv[3]) : 1.0;
+
+	printf("%u CPUs\n", thread::hardware_concurrency());
+	Run(1, subscribers, runSeconds, false);
+	Run(1, subscribers, runSeconds, true);
+	Run(invokers, subscribers, runSeconds, false);
+	Run(invokers, subscribers, runSeconds, true);
+	return 0;
+}
@@ -0,0 +1,69 @@
+// Exercises the C++20 coroutine adapters. Many coroutines repeatedly await an
+// AsyncCallback on one thread and hop to a second thread, so frames are
+// allocated, suspended, resumed across threads and recycled through the pool.
+//
+// Usage: CoroutineStress [coroutines] [awaits]
+
+#include "Coroutine.h"
+#include "WorkerThreadStd.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+static WorkerThread threadA("CoroutineA");
+static WorkerThread threadB("CoroutineB");
+static AsyncCallback<int> ticks;
+static atomic<int> resumes(0);
+static atomic<int> completed(0);
+
+//----------------------------------------------------------------------------
+// Waiter - awaits the next tick on thread A then continues on thread B
+//----------------------------------------------------------------------------
+static CoTask Waiter(int awaits)
+{
+	for (int i = 0; i < awaits; i++)
+	{
+		co_await AwaitCallback(ticks, threadA);
+		co_await ResumeOn(threadB);
+		resumes++;
+	}
+	completed++;
+}
+
+//----------------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	int coroutines = argc > 1 ? atoi(argv[1]) : 1000;
+	int awaits = argc > 2 ? atoi(argv[2]) : 100;
+
+	threadA.CreateThread();
+	threadB.CreateThread();
+
+	auto start = steady_clock::now();
+	for (int i = 0; i < coroutines; i++)
+		Waiter(awaits);
+
+	// A coroutine misses a tick invoked before it registers again, so keep
+	// ticking until every coroutine has finished
+	int tick = 0;
+	while (completed < coroutines && steady_clock::now() - start < seconds(60))
+	{
+		ticks(tick++);
+		this_thread::sleep_for(milliseconds(1));
+	}
+	double elapsed = duration<double>(steady_clock::now() - start).count();
+
+	threadA.ExitThread();
+	threadB.ExitThread();
+
+	printf("%d/%d coroutines completed, %d resumes in %.2f s (%d ticks)\n",
+		(int)completed, coroutines, (int)resumes, elapsed, tick);
+	return completed == coroutines ? 0 : 1;
+}
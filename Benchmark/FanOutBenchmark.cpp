@@ -0,0 +1,98 @@
+// Measures AsyncCallback::Invoke() with and without fan-out for 10, 1,000 and
+// 100,000 subscribers spread over 16 worker threads. Publish is the time the
+// invoking thread spends in Invoke(). Deliver is the time until every 
+// subscriber has been called.
+//
+// Usage: FanOutBenchmark [fanOutThreads] [threshold]
+
+#include "AsyncCallback.h"
+#include "WorkerThreadStd.h"
+#include "WorkerThreadGroup.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+static const int SUBSCRIBER_THREADS = 16;
+static atomic<long> delivered(0);
+
+//----------------------------------------------------------------------------
+// Subscriber
+//----------------------------------------------------------------------------
+static void Subscriber(const int& data, void* /*userData*/)
+{
+	delivered.fetch_add(data, memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// Measure - invoke repeatedly and print the average publish and delivery time
+//----------------------------------------------------------------------------
+static void Measure(int subscribers, CallbackThread* fanOutThread, UINT32 threshold, 
+	vector<unique_ptr<WorkerThread>>& threads)
+{
+	AsyncCallback<int> callback;
+	for (int i = 0; i < subscribers; i++)
+		callback.Register(&Subscriber, threads[i % threads.size()].get(), reinterpret_cast<void*>(static_cast<intptr_t>(i)));
+	if (fanOutThread != NULL)
+		callback.SetFanOut(fanOutThread, threshold);
+
+	const int invokes = subscribers >= 100000 ? 10 : (subscribers >= 1000 ? 200 : 2000);
+	const long expected = static_cast<long>(subscribers) * invokes;
+	delivered = 0;
+
+	auto start = steady_clock::now();
+	for (int i = 0; i < invokes; i++)
+		callback(1);
+	auto published = steady_clock::now();
+
+	while (delivered < expected && steady_clock::now() - start < seconds(60))
+		this_thread::yield();
+	auto done = steady_clock::now();
+
+	printf("%7d subscribers  fan-out %-3s  publish %10.1f us/invoke  deliver %10.1f us/invoke  %s\n",
+		subscribers, fanOutThread != NULL ? "on" : "off",
+		duration<double, micro>(published - start).count() / invokes,
+		duration<double, micro>(done - start).count() / invokes,
+		delivered == expected ? "ok" : "INCOMPLETE");
+}
+
+//----------------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	size_t fanOutThreads = argc > 1 ? atoi(argv[1]) : 4;
+	UINT32 threshold = argc > 2 ? atoi(argv[2]) : 256;
+
+	vector<unique_ptr<WorkerThread>> threads;
+	for (int i = 0; i < SUBSCRIBER_THREADS; i++)
+	{
+		threads.emplace_back(new WorkerThread("Subscriber" + to_string(i)));
+		threads.back()->CreateThread();
+	}
+
+	WorkerThreadGroup fanOut("FanOut", fanOutThreads);
+	fanOut.CreateThread();
+
+	printf("%d subscriber threads, %u fan-out threads, threshold %u, %u CPUs\n", SUBSCRIBER_THREADS,
+		static_cast<unsigned>(fanOutThreads), threshold, thread::hardware_concurrency());
+
+	const int counts[] = { 10, 1000, 100000 };
+	for (int subscribers : counts)
+	{
+		Measure(subscribers, NULL, threshold, threads);
+		Measure(subscribers, &fanOut, threshold, threads);
+	}
+
+	fanOut.ExitThread();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i]->ExitThread();
+	return 0;
+}
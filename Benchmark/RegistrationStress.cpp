@@ -0,0 +1,201 @@
+// Races AsyncCallback Register(), Unregister() and Invoke() across threads.
+// Churn threads register bursts of callbacks and unregister them in random
+// order, so the invocation list is repeatedly grown and compacted and the
+// epoch table grows as registration IDs climb. Invoking threads run
+// throughout. The program checks that:
+//   - callbacks registered for the whole run receive every invoke
+//   - a handle is unregistered exactly once, even after its ID is reused
+//   - no unregistered callback is called by a later invoke
+// Run under AddressSanitizer or ThreadSanitizer for memory and race checks.
+//
+// Usage: RegistrationStress [seconds] [invokers] [churners]
+
+#include "AsyncCallback.h"
+#include "WorkerThreadStd.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+static const int PERMANENT = 4;
+static const int MAX_BURST = 300;
+
+struct Sample
+{
+	/// 1 while churning, 2 once every churned callback is unregistered
+	int phase;
+};
+
+static atomic<UINT64> permanentCalls(0);
+static atomic<UINT64> churnedCalls(0);
+static atomic<UINT64> lateCalls(0);
+static atomic<UINT64> failures(0);
+
+//----------------------------------------------------------------------------
+// Permanent - registered for the whole run
+//----------------------------------------------------------------------------
+static void Permanent(const Sample& /*sample*/, void* /*userData*/)
+{
+	permanentCalls++;
+}
+
+//----------------------------------------------------------------------------
+// Churned - registered and unregistered by the churn threads
+//----------------------------------------------------------------------------
+static void Churned(const Sample& sample, void* /*userData*/)
+{
+	churnedCalls++;
+	if (sample.phase == 2)
+		lateCalls++;
+}
+
+//----------------------------------------------------------------------------
+// Fail
+//----------------------------------------------------------------------------
+static void Fail(const char* what)
+{
+	if (failures++ == 0)
+		fprintf(stderr, "FAILED: %s\n", what);
+}
+
+//----------------------------------------------------------------------------
+// Churn - register a burst of callbacks then unregister them in random order
+//----------------------------------------------------------------------------
+static void Churn(AsyncCallback<Sample>& callback, vector<WorkerThread*>& threads, atomic<bool>& stop, 
+	unsigned seed, UINT64& bursts)
+{
+	mt19937 random(seed);
+	vector<CallbackHandle> handles;
+
+	while (!stop)
+	{
+		size_t burst = 1 + random() % MAX_BURST;
+		for (size_t i = 0; i < burst; i++)
+		{
+			WorkerThread* thread = threads[random() % threads.size()];
+			CallbackPriority priority = static_cast<CallbackPriority>(random() % PRIORITY_LANES);
+			handles.push_back(callback.Register(&Churned, thread, NULL, DISPATCH_DEFAULT, priority));
+		}
+
+		shuffle(handles.begin(), handles.end(), random);
+		for (size_t i = 0; i < handles.size(); i++)
+		{
+			if (!callback.Unregister(handles[i]))
+				Fail("Unregister() of a registered handle returned FALSE");
+
+			// The freed ID is reused by the next registration. The stale 
+			// handle must not remove it. 
+			if (i % 16 == 0)
+			{
+				CallbackHandle reused = callback.Register(&Churned, threads[0]);
+				if (callback.Unregister(handles[i]))
+					Fail("Unregister() of a stale handle returned TRUE");
+				if (!callback.Unregister(reused))
+					Fail("Unregister() of a reused ID returned FALSE");
+			}
+		}
+		handles.clear();
+		bursts++;
+	}
+}
+
+//----------------------------------------------------------------------------
+// WaitIdle - wait until every thread queue is empty
+//----------------------------------------------------------------------------
+static void WaitIdle(vector<WorkerThread*>& threads)
+{
+	for (int stable = 0; stable < 3; )
+	{
+		this_thread::sleep_for(milliseconds(20));
+		size_t depth = 0;
+		for (size_t i = 0; i < threads.size(); i++)
+			depth += threads[i]->GetQueueDepth();
+		stable = depth == 0 ? stable + 1 : 0;
+	}
+}
+
+//----------------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	double runSeconds = argc > 1 ? atof(argv[1]) : 2.0;
+	int invokers = argc > 2 ? atoi(argv[2]) : 4;
+	int churners = argc > 3 ? atoi(argv[3]) : 2;
+
+	WorkerThread threadA("StressA"), threadB("StressB"), threadC("StressC");
+	vector<WorkerThread*> threads = { &threadA, &threadB, &threadC };
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i]->CreateThread();
+
+	AsyncCallback<Sample> callback;
+	for (int i = 0; i < PERMANENT; i++)
+		callback.Register(&Permanent, threads[i % threads.size()], reinterpret_cast<void*>(static_cast<intptr_t>(i)));
+
+	atomic<bool> stop(false);
+	vector<UINT64> bursts(churners, 0);
+	vector<thread> churnThreads;
+	for (int i = 0; i < churners; i++)
+		churnThreads.emplace_back(Churn, ref(callback), ref(threads), ref(stop), 1234u + i, ref(bursts[i]));
+
+	atomic<UINT64> invokes(0);
+	vector<thread> invokeThreads;
+	for (int i = 0; i < invokers; i++)
+	{
+		invokeThreads.emplace_back([&]() {
+			Sample sample = { 1 };
+			while (!stop)
+			{
+				callback(sample);
+				invokes++;
+
+				// Let the worker threads keep up
+				if (invokes % 64 == 0)
+					this_thread::yield();
+			}
+		});
+	}
+
+	this_thread::sleep_for(duration<double>(runSeconds));
+	stop = true;
+	for (size_t i = 0; i < invokeThreads.size(); i++)
+		invokeThreads[i].join();
+	for (size_t i = 0; i < churnThreads.size(); i++)
+		churnThreads[i].join();
+
+	// Every churned callback is unregistered. Later invokes only reach the
+	// permanent callbacks. 
+	const int PHASE_2_INVOKES = 1000;
+	Sample sample = { 2 };
+	for (int i = 0; i < PHASE_2_INVOKES; i++)
+		callback(sample);
+	WaitIdle(threads);
+
+	UINT64 expected = (invokes + PHASE_2_INVOKES) * PERMANENT;
+	if (permanentCalls != expected)
+		Fail("a permanent callback missed an invoke");
+	if (lateCalls != 0)
+		Fail("an unregistered callback was called by a later invoke");
+
+	UINT64 totalBursts = 0;
+	for (size_t i = 0; i < bursts.size(); i++)
+		totalBursts += bursts[i];
+
+	printf("%llu invokes, %llu bursts, %llu churned calls, %u cancelled in queue\n",
+		static_cast<unsigned long long>(invokes.load()), static_cast<unsigned long long>(totalBursts), 
+		static_cast<unsigned long long>(churnedCalls.load()), callback.GetCancelledCount());
+	printf("permanent calls %llu of %llu, late calls %llu: %s\n",
+		static_cast<unsigned long long>(permanentCalls.load()), static_cast<unsigned long long>(expected),
+		static_cast<unsigned long long>(lateCalls.load()), failures == 0 ? "PASSED" : "FAILED");
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i]->ExitThread();
+	return failures == 0 ? 0 : 1;
+}
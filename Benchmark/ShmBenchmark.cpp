@@ -0,0 +1,434 @@
+// Compares AsyncCallback delivery across processes against a Unix domain
+// socket. The callback path invokes an AsyncCallback registered on a 
+// ShmCallbackThread and runs a ShmCallbackReceiver handler in the other 
+// process. A raw ShmRing row is the baseline cost of the ring alone. 
+// Latency is measured as ping-pong round trips and throughput as one-way
+// messages that the consumer acknowledges once at the end.
+//
+// Usage: ShmBenchmark [messages]
+
+#include "ShmRing.h"
+#include "ShmCallbackThread.h"
+#include "ShmCallbackReceiver.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static const UINT32 TOPIC_DATA = 1;
+static const UINT32 TOPIC_DONE = 2;
+static const UINT32 TOPIC_PING = 3;
+static const UINT32 SLOT_COUNT = 1024;
+static const char* REQUEST_NAME = "/ShmBenchmarkRequest";
+static const char* RESPONSE_NAME = "/ShmBenchmarkResponse";
+
+/// The callback data sent each message
+struct Payload
+{
+	UINT32 Sequence;
+	char Data[60];
+};
+
+//----------------------------------------------------------------------------
+// Transport - one end of a bidirectional channel between the two processes
+//----------------------------------------------------------------------------
+class Transport
+{
+public:
+	virtual ~Transport() {}
+	virtual void Send(UINT32 topic, const void* data, UINT32 size) = 0;
+	virtual UINT32 Receive(void* data, UINT32 size) = 0;
+};
+
+//----------------------------------------------------------------------------
+// RingTransport - sends on one ShmRing and receives on another
+//----------------------------------------------------------------------------
+class RingTransport : public Transport
+{
+public:
+	RingTransport(ShmRing& tx, ShmRing& rx) : m_tx(tx), m_rx(rx) {}
+
+	virtual void Send(UINT32 topic, const void* data, UINT32 size)
+	{
+		// Ring full? Let the consumer run.
+		while (!m_tx.Write(topic, data, size))
+			sched_yield();
+	}
+
+	virtual UINT32 Receive(void* data, UINT32 size)
+	{
+		UINT32 topic, msgSize;
+		const void* msg;
+		while ((msg = m_rx.Peek(topic, msgSize)) == NULL)
+			m_rx.Wait(100);
+		memcpy(data, msg, msgSize < size ? msgSize : size);
+		m_rx.Pop();
+		return topic;
+	}
+
+private:
+	ShmRing& m_tx;
+	ShmRing& m_rx;
+};
+
+//----------------------------------------------------------------------------
+// SocketTransport - a SOCK_SEQPACKET socket pair. The topic prefixes the data.
+//----------------------------------------------------------------------------
+class SocketTransport : public Transport
+{
+public:
+	explicit SocketTransport(int fd) : m_fd(fd) {}
+
+	virtual void Send(UINT32 topic, const void* data, UINT32 size)
+	{
+		m_buffer.resize(sizeof(topic) + size);
+		memcpy(&m_buffer[0], &topic, sizeof(topic));
+		memcpy(&m_buffer[sizeof(topic)], data, size);
+		if (write(m_fd, &m_buffer[0], m_buffer.size()) != (ssize_t)m_buffer.size())
+		{
+			perror("write");
+			exit(1);
+		}
+	}
+
+	virtual UINT32 Receive(void* data, UINT32 size)
+	{
+		m_buffer.resize(sizeof(UINT32) + size);
+		ssize_t len = read(m_fd, &m_buffer[0], m_buffer.size());
+		if (len < (ssize_t)sizeof(UINT32))
+		{
+			perror("read");
+			exit(1);
+		}
+		UINT32 topic;
+		memcpy(&topic, &m_buffer[0], sizeof(topic));
+		memcpy(data, &m_buffer[sizeof(topic)], len - sizeof(topic));
+		return topic;
+	}
+
+private:
+	int m_fd;
+	vector<char> m_buffer;
+};
+
+//----------------------------------------------------------------------------
+// Echo - the child process. Echoes each message and acknowledges the end of
+// a throughput run with the number of messages received.
+//----------------------------------------------------------------------------
+static void Echo(Transport& transport, UINT32 messages, UINT32 size)
+{
+	vector<char> data(size);
+
+	// Latency phase
+	for (UINT32 i = 0; i < messages; i++)
+	{
+		transport.Receive(&data[0], size);
+		transport.Send(TOPIC_DATA, &data[0], size);
+	}
+
+	// Throughput phase
+	UINT32 received = 0;
+	while (transport.Receive(&data[0], size) != TOPIC_DONE)
+		received++;
+	transport.Send(TOPIC_DONE, &received, sizeof(received));
+}
+
+//----------------------------------------------------------------------------
+// Measure - the parent process. Prints the round trip latency and the
+// one-way throughput.
+//----------------------------------------------------------------------------
+static void Measure(const char* name, Transport& transport, UINT32 messages, UINT32 size)
+{
+	vector<char> data(size, 'x');
+
+	vector<INT64> rttNs(messages);
+	for (UINT32 i = 0; i < messages; i++)
+	{
+		auto start = steady_clock::now();
+		transport.Send(TOPIC_DATA, &data[0], size);
+		transport.Receive(&data[0], size);
+		rttNs[i] = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+	}
+
+	auto start = steady_clock::now();
+	for (UINT32 i = 0; i < messages; i++)
+		transport.Send(TOPIC_DATA, &data[0], size);
+	transport.Send(TOPIC_DONE, &data[0], size);
+
+	UINT32 received = 0;
+	transport.Receive(&received, sizeof(received));
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	sort(rttNs.begin(), rttNs.end());
+	printf("%-8s rtt p50 %6.2f us  p99 %7.2f us  throughput %7.3f M msg/s  (%u/%u received)\n",
+		name, rttNs[messages / 2] / 1000.0, rttNs[messages * 99 / 100] / 1000.0,
+		messages / seconds / 1e6, received, messages);
+}
+
+//----------------------------------------------------------------------------
+// RunRing
+//----------------------------------------------------------------------------
+static void RunRing(UINT32 messages, UINT32 size)
+{
+	// The parent creates both rings so the child can open them after the fork
+	ShmRing request, response;
+	if (!request.Create(REQUEST_NAME, SLOT_COUNT, size) ||
+		!response.Create(RESPONSE_NAME, SLOT_COUNT, size))
+	{
+		fprintf(stderr, "ShmRing::Create failed\n");
+		exit(1);
+	}
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		ShmRing childRequest, childResponse;
+		if (!childRequest.Open(REQUEST_NAME) || !childResponse.Open(RESPONSE_NAME))
+			_exit(1);
+		RingTransport transport(childResponse, childRequest);
+		Echo(transport, messages, size);
+		_exit(0);
+	}
+
+	RingTransport transport(request, response);
+	Measure("ShmRing", transport, messages, size);
+	waitpid(pid, NULL, 0);
+}
+
+//----------------------------------------------------------------------------
+// Sync - exchange one byte with the other process over a socket pair
+//----------------------------------------------------------------------------
+static void Sync(int fd)
+{
+	char byte = 0;
+	if (write(fd, &byte, 1) != 1 || read(fd, &byte, 1) != 1)
+	{
+		perror("sync");
+		_exit(1);
+	}
+}
+
+//----------------------------------------------------------------------------
+// CallbackEcho - the child process of the callback run. Its receiver thread
+// echoes pings and counts data messages, then reports the count when done.
+//----------------------------------------------------------------------------
+struct CallbackEcho
+{
+	AsyncCallback<Payload> Pong;
+	AsyncCallback<UINT32> Count;
+	UINT32 Received;
+	std::atomic<bool> Done;
+};
+
+static void OnPing(const Payload& data, void* userData)
+{
+	CallbackEcho* echo = static_cast<CallbackEcho*>(userData);
+	while (!echo->Pong(data))
+		sched_yield();
+}
+
+static void OnData(const Payload& /*data*/, void* userData)
+{
+	static_cast<CallbackEcho*>(userData)->Received++;
+}
+
+static void OnDone(const UINT32& /*data*/, void* userData)
+{
+	CallbackEcho* echo = static_cast<CallbackEcho*>(userData);
+	while (!echo->Count(echo->Received))
+		sched_yield();
+	echo->Done = true;
+}
+
+static void RunCallbackEcho(int syncFd)
+{
+	ShmCallbackReceiver receiver("ShmBenchmarkEcho");
+	if (!receiver.CreateThread(REQUEST_NAME, SLOT_COUNT, sizeof(Payload)))
+		_exit(1);
+
+	// The parent's response ring exists once both processes synchronize
+	Sync(syncFd);
+	ShmRing response;
+	if (!response.Open(RESPONSE_NAME))
+		_exit(1);
+
+	CallbackEcho echo;
+	echo.Received = 0;
+	echo.Done = false;
+	ShmCallbackThread pongThread(response, TOPIC_PING);
+	ShmCallbackThread countThread(response, TOPIC_DONE);
+	pongThread.Subscribe(echo.Pong);
+	countThread.Subscribe(echo.Count);
+
+	receiver.Register(TOPIC_PING, &OnPing, &echo);
+	receiver.Register(TOPIC_DATA, &OnData, &echo);
+	receiver.Register(TOPIC_DONE, &OnDone, &echo);
+	Sync(syncFd);
+
+	while (!echo.Done)
+		usleep(1000);
+	receiver.ExitThread();
+}
+
+//----------------------------------------------------------------------------
+// CallbackMeasure - the parent process of the callback run
+//----------------------------------------------------------------------------
+static std::atomic<UINT32> s_pong;
+static std::atomic<UINT32> s_count;
+
+static void OnPong(const Payload& data, void* /*userData*/)
+{
+	s_pong.store(data.Sequence, std::memory_order_release);
+}
+
+static void OnCount(const UINT32& data, void* /*userData*/)
+{
+	s_count.store(data, std::memory_order_release);
+}
+
+static void RunCallback(UINT32 messages)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+	{
+		perror("socketpair");
+		exit(1);
+	}
+
+	// Fork before starting threads. Each process creates the ring it reads.
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		RunCallbackEcho(fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+
+	s_pong = 0;
+	s_count = 0xFFFFFFFF;
+	ShmCallbackReceiver receiver("ShmBenchmarkMeasure");
+	if (!receiver.CreateThread(RESPONSE_NAME, SLOT_COUNT, sizeof(Payload)))
+	{
+		fprintf(stderr, "ShmCallbackReceiver::CreateThread failed\n");
+		exit(1);
+	}
+	receiver.Register(TOPIC_PING, &OnPong);
+	receiver.Register(TOPIC_DONE, &OnCount);
+
+	Sync(fds[0]);
+	ShmRing request;
+	if (!request.Open(REQUEST_NAME))
+	{
+		fprintf(stderr, "ShmRing::Open failed\n");
+		exit(1);
+	}
+
+	AsyncCallback<Payload> ping, data;
+	AsyncCallback<UINT32> done;
+	ShmCallbackThread pingThread(request, TOPIC_PING);
+	ShmCallbackThread dataThread(request, TOPIC_DATA);
+	ShmCallbackThread doneThread(request, TOPIC_DONE);
+	pingThread.Subscribe(ping);
+	dataThread.Subscribe(data);
+	doneThread.Subscribe(done);
+
+	// Wait for the child's handlers
+	Sync(fds[0]);
+
+	Payload payload;
+	memset(&payload, 'x', sizeof(payload));
+
+	vector<INT64> rttNs(messages);
+	for (UINT32 i = 0; i < messages; i++)
+	{
+		payload.Sequence = i + 1;
+		auto start = steady_clock::now();
+		ping(payload);
+		while (s_pong.load(std::memory_order_acquire) != payload.Sequence)
+			sched_yield();
+		rttNs[i] = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+	}
+
+	// A full ring rejects the data, so retry until the receiver catches up
+	auto start = steady_clock::now();
+	for (UINT32 i = 0; i < messages; i++)
+	{
+		payload.Sequence = i;
+		while (!data(payload))
+			sched_yield();
+	}
+	while (!done(messages))
+		sched_yield();
+	while (s_count.load(std::memory_order_acquire) == 0xFFFFFFFF)
+		sched_yield();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	sort(rttNs.begin(), rttNs.end());
+	printf("%-8s rtt p50 %6.2f us  p99 %7.2f us  throughput %7.3f M msg/s  (%u/%u received)\n",
+		"Callback", rttNs[messages / 2] / 1000.0, rttNs[messages * 99 / 100] / 1000.0,
+		messages / seconds / 1e6, s_count.load(), messages);
+
+	waitpid(pid, NULL, 0);
+	receiver.ExitThread();
+	close(fds[0]);
+}
+
+//----------------------------------------------------------------------------
+// RunSocket
+//----------------------------------------------------------------------------
+static void RunSocket(UINT32 messages, UINT32 size)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0)
+	{
+		perror("socketpair");
+		exit(1);
+	}
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		SocketTransport transport(fds[1]);
+		Echo(transport, messages, size);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	SocketTransport transport(fds[0]);
+	Measure("UDS", transport, messages, size);
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+}
+
+//----------------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	UINT32 messages = argc > 1 ? (UINT32)atoi(argv[1]) : 100000;
+	const UINT32 size = sizeof(Payload);
+	if (messages == 0)
+	{
+		fprintf(stderr, "Usage: ShmBenchmark [messages]\n");
+		return 1;
+	}
+
+	printf("%u messages of %u bytes, %ld CPUs\n", messages, size, sysconf(_SC_NPROCESSORS_ONLN));
+	RunRing(messages, size);
+	RunCallback(messages);
+	RunSocket(messages, size);
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include "ShmCallbackReceiver.h"
+#include "Fault.h"
+#include <pthread.h>
+
+using namespace std;
+
+// Longest sleep before rechecking for exit
+static const UINT32 WAIT_TIMEOUT_MS = 100;
+
+//----------------------------------------------------------------------------
+// ShmCallbackReceiver
+//----------------------------------------------------------------------------
+ShmCallbackReceiver::ShmCallbackReceiver(const std::string& threadName) :
+	m_threadId(),
+	m_exit(false),
+	m_discarded(0),
+	m_running(false),
+	THREAD_NAME(threadName)
+{
+}
+
+//----------------------------------------------------------------------------
+// ~ShmCallbackReceiver
+//----------------------------------------------------------------------------
+ShmCallbackReceiver::~ShmCallbackReceiver()
+{
+	ExitThread();
+}
+
+//----------------------------------------------------------------------------
+// CreateThread
+//----------------------------------------------------------------------------
+bool ShmCallbackReceiver::CreateThread(const std::string& name, UINT32 slotCount, UINT32 slotSize)
+{
+	if (m_thread.joinable())
+		return true;
+
+	if (!m_ring.Create(name, slotCount, slotSize))
+		return false;
+
+	m_exit = false;
+	m_thread = std::thread(&ShmCallbackReceiver::Process, this);
+	pthread_setname_np(m_thread.native_handle(), THREAD_NAME.substr(0, 15).c_str());
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// ExitThread
+//----------------------------------------------------------------------------
+void ShmCallbackReceiver::ExitThread()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_exit = true;
+	m_ring.Wake();
+	m_thread.join();
+	m_ring.Close();
+}
+
+//----------------------------------------------------------------------------
+// Register
+//----------------------------------------------------------------------------
+void ShmCallbackReceiver::Register(UINT32 topic, Callback::CallbackFunc func, void* userData, size_t size)
+{
+	ASSERT_TRUE(func != NULL);
+
+	Handler handler;
+	handler.Func = func;
+	handler.UserData = userData;
+	handler.Size = size;
+
+	lock_guard<mutex> lock(m_lock);
+	m_handlers[topic] = handler;
+}
+
+//----------------------------------------------------------------------------
+// Unregister
+//----------------------------------------------------------------------------
+void ShmCallbackReceiver::Unregister(UINT32 topic)
+{
+	unique_lock<mutex> lk(m_lock);
+	m_handlers.erase(topic);
+
+	// A handler running on the receiver thread may still use its user data
+	if (m_threadId.load() != this_thread::get_id())
+	{
+		while (m_running)
+			m_cvIdle.wait(lk);
+	}
+}
+
+//----------------------------------------------------------------------------
+// Process
+//----------------------------------------------------------------------------
+void ShmCallbackReceiver::Process()
+{
+	m_threadId = this_thread::get_id();
+
+	while (!m_exit)
+	{
+		UINT32 topic, size;
+		const void* data = m_ring.Peek(topic, size);
+		if (data == NULL)
+		{
+			m_ring.Wait(WAIT_TIMEOUT_MS);
+			continue;
+		}
+
+		Handler handler;
+		bool found = false;
+		{
+			lock_guard<mutex> lock(m_lock);
+			auto it = m_handlers.find(topic);
+			if (it != m_handlers.end() && it->second.Size == size)
+			{
+				handler = it->second;
+				found = true;
+				m_running = true;
+			}
+		}
+
+		if (found)
+		{
+			// Call without the lock so the handler may call back into the receiver
+			(*handler.Func)(data, handler.UserData);
+			{
+				lock_guard<mutex> lock(m_lock);
+				m_running = false;
+			}
+			m_cvIdle.notify_all();
+		}
+		else
+			m_discarded++;
+
+		// Release the slot once the handler is done with the data
+		m_ring.Pop();
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef _SHM_CALLBACK_RECEIVER_H
+#define _SHM_CALLBACK_RECEIVER_H
+
+#include "ShmRing.h"
+#include "Callback.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <map>
+#include <string>
+
+/// @brief A thread in the receiving process that reads a shared memory ring
+/// and calls the function registered for each message topic. The callback
+/// data is passed by reference directly from the ring without another copy.
+/// @details Forward to a WorkerThread, for instance by invoking a local
+/// AsyncCallback, to reach a state machine.
+class ShmCallbackReceiver
+{
+public:
+	/// Constructor
+	/// @param[in] threadName - the receiver thread name.
+	ShmCallbackReceiver(const std::string& threadName);
+
+	/// Destructor
+	~ShmCallbackReceiver();
+
+	/// Create the ring and start the receiver thread.
+	/// @param[in] name - the shared memory name, such as "/status".
+	/// @param[in] slotCount - the number of slots. Must be a power of two.
+	/// @param[in] slotSize - the largest callback data size in bytes.
+	/// @return TRUE if created.
+	bool CreateThread(const std::string& name, UINT32 slotCount, UINT32 slotSize);
+
+	/// Stop the receiver thread and remove the ring.
+	void ExitThread();
+
+	/// Register the function called for a topic on the receiver thread.
+	/// @param[in] topic - the topic given to the sending ShmCallbackThread.
+	/// @param[in] func - the callback function.
+	/// @param[in] userData - optional user data returned as-is on the callback.
+	template <class TData>
+	void Register(UINT32 topic, void (*func)(const TData& data, void* userData), void* userData = NULL)
+	{
+		Register(topic, reinterpret_cast<Callback::CallbackFunc>(func), userData, sizeof(TData));
+	}
+
+	/// Unregister a topic. Waits for a running handler to return, so the 
+	/// handler is never called afterwards, unless called by the handler itself.
+	/// @param[in] topic - a registered topic.
+	void Unregister(UINT32 topic);
+
+	/// Get the number of messages discarded because no function was registered
+	/// for the topic or the size didn't match the registered data type.
+	UINT32 GetDiscardedCount() const { return m_discarded; }
+
+private:
+	struct Handler
+	{
+		Callback::CallbackFunc Func;
+		void* UserData;
+		size_t Size;
+	};
+
+	/// Register a topic handler.
+	void Register(UINT32 topic, Callback::CallbackFunc func, void* userData, size_t size);
+
+	/// Entry point for the receiver thread
+	void Process();
+
+	ShmRing m_ring;
+	std::thread m_thread;
+	std::atomic<std::thread::id> m_threadId;
+	std::atomic<bool> m_exit;
+	std::atomic<UINT32> m_discarded;
+
+	/// Topic handlers. Guarded by m_lock. Handlers run without the lock, so
+	/// a handler may register, unregister or send to this receiver.
+	std::map<UINT32, Handler> m_handlers;
+	std::mutex m_lock;
+
+	/// TRUE while a handler runs. Guarded by m_lock.
+	bool m_running;
+	std::condition_variable m_cvIdle;
+
+	const std::string THREAD_NAME;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "ShmCallbackThread.h"
+
+//----------------------------------------------------------------------------
+// ShmCallbackThread
+//----------------------------------------------------------------------------
+ShmCallbackThread::ShmCallbackThread(ShmRing& ring, UINT32 topic) :
+	m_ring(ring),
+	m_topic(topic),
+	m_rejected(0)
+{
+	ASSERT_TRUE(m_ring.IsOpen());
+}
+
+//----------------------------------------------------------------------------
+// DispatchCallback
+//----------------------------------------------------------------------------
+bool ShmCallbackThread::DispatchCallback(CallbackMsg* msg)
+{
+	m_rejected++;
+	msg->GetAsyncCallback()->TargetDiscard(&msg);
+	return false;
+}
+
+//----------------------------------------------------------------------------
+// DispatchData
+//----------------------------------------------------------------------------
+bool ShmCallbackThread::DispatchData(const Callback& /*callback*/, const void* data, size_t size)
+{
+	if (size > m_ring.GetSlotSize() || !m_ring.Write(m_topic, data, static_cast<UINT32>(size)))
+	{
+		m_rejected++;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,63 @@
+#ifndef _SHM_CALLBACK_THREAD_H
+#define _SHM_CALLBACK_THREAD_H
+
+#include "AsyncCallback.h"
+#include "ShmRing.h"
+#include <type_traits>
+
+/// @brief A CallbackThread standing in for a ShmCallbackReceiver thread in
+/// another process. Callback data registered to this thread is copied once,
+/// directly into the shared memory ring, and tagged with the topic.
+/// @details Only trivially copyable data can cross the process boundary. A
+/// full ring rejects the data and AsyncCallback::Invoke() returns false.
+class ShmCallbackThread : public CallbackThread
+{
+public:
+	/// Constructor
+	/// @param[in] ring - an open ring shared with the receiving process.
+	/// @param[in] topic - identifies the callback to the receiver.
+	ShmCallbackThread(ShmRing& ring, UINT32 topic);
+
+	/// Forward an AsyncCallback to the receiving process.
+	/// @param[in] asyncCallback - the callback to forward.
+	template <class TData>
+	void Subscribe(AsyncCallback<TData>& asyncCallback)
+	{
+		static_assert(std::is_trivially_copyable<TData>::value,
+			"Shared memory callback data must be trivially copyable");
+		asyncCallback.Register(&Forward<TData>, this);
+	}
+
+	/// Stop forwarding an AsyncCallback.
+	/// @param[in] asyncCallback - a forwarded callback.
+	template <class TData>
+	void Unsubscribe(AsyncCallback<TData>& asyncCallback)
+	{
+		asyncCallback.Unregister(&Forward<TData>, this);
+	}
+
+	/// Rejects the message. Data that isn't trivially copyable can't be sent.
+	virtual bool DispatchCallback(CallbackMsg* msg);
+
+	/// @see CallbackThread::IsCopyTransport
+	virtual bool IsCopyTransport() const { return true; }
+
+	/// @see CallbackThread::DispatchData
+	virtual bool DispatchData(const Callback& callback, const void* data, size_t size);
+
+	/// Get the number of callbacks rejected because the ring was full or the
+	/// data too large.
+	UINT32 GetRejectedCount() const { return m_rejected; }
+
+private:
+	/// Registered as the callback function. Never called because the data is
+	/// delivered through the ring.
+	template <class TData>
+	static void Forward(const TData& /*data*/, void* /*userData*/) { ASSERT(); }
+
+	ShmRing& m_ring;
+	const UINT32 m_topic;
+	std::atomic<UINT32> m_rejected;
+};
+
+#endif
@@ -0,0 +1,304 @@
+#include "ShmRing.h"
+#include "Fault.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+
+// Identifies an initialized ring
+static const UINT32 SHM_RING_MAGIC = 0x52494E47;
+
+// Slot payloads are aligned for any trivially copyable callback data
+static const UINT32 SLOT_ALIGN = 16;
+
+#if ATOMIC_LLONG_LOCK_FREE != 2 || ATOMIC_INT_LOCK_FREE != 2
+#error ShmRing requires lock-free atomics shared between processes
+#endif
+
+/// Shared header at the start of the mapping
+struct ShmRing::Header
+{
+	std::atomic<UINT32> magic;
+	UINT32 slotCount;
+	UINT32 slotSize;
+	UINT32 slotStride;
+
+	/// Next position claimed by a producer
+	alignas(64) std::atomic<UINT64> head;
+
+	/// Next position read by the consumer
+	alignas(64) std::atomic<UINT64> tail;
+
+	/// 1 while the consumer sleeps. The futex word.
+	alignas(64) std::atomic<UINT32> waiting;
+};
+
+/// Slot header followed by the payload
+struct ShmRing::Slot
+{
+	std::atomic<UINT64> sequence;
+	UINT32 topic;
+	UINT32 size;
+};
+
+//----------------------------------------------------------------------------
+// HeaderSize
+//----------------------------------------------------------------------------
+static inline size_t HeaderSize(size_t size)
+{
+	return (size + SLOT_ALIGN - 1) & ~static_cast<size_t>(SLOT_ALIGN - 1);
+}
+
+//----------------------------------------------------------------------------
+// Futex
+//----------------------------------------------------------------------------
+static inline long Futex(std::atomic<UINT32>* word, int op, UINT32 value, const timespec* timeout)
+{
+	// The word is shared between processes so the private futex ops can't be used
+	return syscall(SYS_futex, reinterpret_cast<UINT32*>(word), op, value, timeout, NULL, 0);
+}
+
+//----------------------------------------------------------------------------
+// ShmRing
+//----------------------------------------------------------------------------
+ShmRing::ShmRing() :
+	m_header(NULL),
+	m_mapSize(0),
+	m_owner(false)
+{
+}
+
+//----------------------------------------------------------------------------
+// ~ShmRing
+//----------------------------------------------------------------------------
+ShmRing::~ShmRing()
+{
+	Close();
+}
+
+//----------------------------------------------------------------------------
+// Create
+//----------------------------------------------------------------------------
+bool ShmRing::Create(const std::string& name, UINT32 slotCount, UINT32 slotSize)
+{
+	ASSERT_TRUE(!IsOpen());
+	ASSERT_TRUE(slotCount != 0 && (slotCount & (slotCount - 1)) == 0);
+
+	UINT32 slotStride = static_cast<UINT32>(HeaderSize(sizeof(Slot)) + HeaderSize(slotSize));
+	size_t mapSize = HeaderSize(sizeof(Header)) + static_cast<size_t>(slotStride) * slotCount;
+
+	// Replace a ring left behind by a previous run
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd == -1)
+		return false;
+	if (ftruncate(fd, static_cast<off_t>(mapSize)) != 0 || !Map(fd, mapSize))
+	{
+		close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	close(fd);
+
+	m_name = name;
+	m_owner = true;
+
+	// A new mapping is zero filled, so only the non-zero fields are set
+	m_header->slotCount = slotCount;
+	m_header->slotSize = slotSize;
+	m_header->slotStride = slotStride;
+	for (UINT32 pos = 0; pos < slotCount; pos++)
+		GetSlot(pos)->sequence.store(pos, std::memory_order_relaxed);
+
+	// Publish the initialized ring to producers that open it
+	m_header->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Open
+//----------------------------------------------------------------------------
+bool ShmRing::Open(const std::string& name)
+{
+	ASSERT_TRUE(!IsOpen());
+
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	bool mapped = fstat(fd, &st) == 0 &&
+		static_cast<size_t>(st.st_size) >= HeaderSize(sizeof(Header)) &&
+		Map(fd, static_cast<size_t>(st.st_size));
+	close(fd);
+	if (!mapped)
+		return false;
+
+	if (m_header->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC)
+	{
+		Close();
+		return false;
+	}
+
+	m_name = name;
+	m_owner = false;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Map
+//----------------------------------------------------------------------------
+bool ShmRing::Map(int fd, size_t size)
+{
+	void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED)
+		return false;
+	m_header = static_cast<Header*>(addr);
+	m_mapSize = size;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Close
+//----------------------------------------------------------------------------
+void ShmRing::Close()
+{
+	if (!IsOpen())
+		return;
+
+	munmap(m_header, m_mapSize);
+	m_header = NULL;
+	m_mapSize = 0;
+
+	if (m_owner)
+		shm_unlink(m_name.c_str());
+	m_owner = false;
+}
+
+//----------------------------------------------------------------------------
+// GetSlotSize
+//----------------------------------------------------------------------------
+UINT32 ShmRing::GetSlotSize() const
+{
+	ASSERT_TRUE(IsOpen());
+	return m_header->slotSize;
+}
+
+//----------------------------------------------------------------------------
+// GetSlot
+//----------------------------------------------------------------------------
+ShmRing::Slot* ShmRing::GetSlot(UINT64 pos) const
+{
+	char* slots = reinterpret_cast<char*>(m_header) + HeaderSize(sizeof(Header));
+	size_t index = static_cast<size_t>(pos & (m_header->slotCount - 1));
+	return reinterpret_cast<Slot*>(slots + index * m_header->slotStride);
+}
+
+//----------------------------------------------------------------------------
+// Write
+//----------------------------------------------------------------------------
+bool ShmRing::Write(UINT32 topic, const void* data, UINT32 size)
+{
+	ASSERT_TRUE(IsOpen());
+	if (size > m_header->slotSize)
+		return false;
+
+	// Claim a slot. A slot is free when its sequence equals the position.
+	UINT64 pos = m_header->head.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (1)
+	{
+		slot = GetSlot(pos);
+		INT64 diff = static_cast<INT64>(slot->sequence.load(std::memory_order_acquire) - pos);
+		if (diff == 0)
+		{
+			if (m_header->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// The consumer hasn't released the slot from the previous lap
+			return false;
+		}
+		else
+		{
+			pos = m_header->head.load(std::memory_order_relaxed);
+		}
+	}
+
+	// The only copy of the message
+	slot->topic = topic;
+	slot->size = size;
+	memcpy(reinterpret_cast<char*>(slot) + HeaderSize(sizeof(Slot)), data, size);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+
+	// Pairs with the fence in Wait() so either the consumer sees the slot or
+	// this producer sees the consumer waiting
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_header->waiting.load(std::memory_order_relaxed) != 0)
+		Wake();
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Peek
+//----------------------------------------------------------------------------
+const void* ShmRing::Peek(UINT32& topic, UINT32& size)
+{
+	ASSERT_TRUE(IsOpen());
+
+	UINT64 pos = m_header->tail.load(std::memory_order_relaxed);
+	Slot* slot = GetSlot(pos);
+	if (slot->sequence.load(std::memory_order_acquire) != pos + 1)
+		return NULL;
+
+	topic = slot->topic;
+	size = slot->size;
+	return reinterpret_cast<char*>(slot) + HeaderSize(sizeof(Slot));
+}
+
+//----------------------------------------------------------------------------
+// Pop
+//----------------------------------------------------------------------------
+void ShmRing::Pop()
+{
+	UINT64 pos = m_header->tail.load(std::memory_order_relaxed);
+
+	// Hand the slot to the producers' next lap
+	GetSlot(pos)->sequence.store(pos + m_header->slotCount, std::memory_order_release);
+	m_header->tail.store(pos + 1, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// Wait
+//----------------------------------------------------------------------------
+void ShmRing::Wait(UINT32 timeoutMs)
+{
+	m_header->waiting.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	// Recheck after announcing the wait so a message published meanwhile
+	// isn't missed
+	UINT32 topic, size;
+	if (Peek(topic, size) == NULL)
+	{
+		timespec timeout;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_nsec = static_cast<long>(timeoutMs % 1000) * 1000000;
+		Futex(&m_header->waiting, FUTEX_WAIT, 1, &timeout);
+	}
+	m_header->waiting.store(0, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// Wake
+//----------------------------------------------------------------------------
+void ShmRing::Wake()
+{
+	m_header->waiting.store(0, std::memory_order_relaxed);
+	Futex(&m_header->waiting, FUTEX_WAKE, 1, NULL);
+}
@@ -0,0 +1,91 @@
+#ifndef _SHM_RING_H
+#define _SHM_RING_H
+
+#include "DataTypes.h"
+#include <atomic>
+#include <string>
+
+/// @brief A bounded multi-producer, single-consumer ring buffer in POSIX shared
+/// memory. Producers in any process copy a message directly into a slot. The
+/// consumer sleeps on a futex in the shared header while the ring is empty.
+/// @details Each slot carries a sequence number. A producer claims a slot by
+/// advancing the head, copies the message and then publishes the slot by
+/// storing its sequence. The consumer reads slots in order and hands each
+/// slot back by advancing its sequence one lap. A producer that dies between
+/// claiming and publishing a slot stalls the consumer at that slot.
+class ShmRing
+{
+public:
+	/// Constructor
+	ShmRing();
+
+	/// Destructor. Unmaps the ring and, for the creator, removes the name.
+	~ShmRing();
+
+	/// Create and initialize a ring. Called by the consuming process.
+	/// @param[in] name - the shared memory name, such as "/status".
+	/// @param[in] slotCount - the number of slots. Must be a power of two.
+	/// @param[in] slotSize - the largest message in bytes.
+	/// @return TRUE if created.
+	bool Create(const std::string& name, UINT32 slotCount, UINT32 slotSize);
+
+	/// Open a ring created by another process. Called by producing processes.
+	/// @param[in] name - the shared memory name.
+	/// @return TRUE if opened.
+	bool Open(const std::string& name);
+
+	/// Unmap the ring. The creator also removes the name.
+	void Close();
+
+	/// Check if the ring is mapped.
+	bool IsOpen() const { return m_header != NULL; }
+
+	/// Get the largest message in bytes.
+	UINT32 GetSlotSize() const;
+
+	/// Copy a message into the ring and wake the consumer if sleeping. May be
+	/// called by any thread in any process.
+	/// @param[in] topic - identifies the message to the consumer.
+	/// @param[in] data - the message bytes.
+	/// @param[in] size - the message size. Must not exceed the slot size.
+	/// @return TRUE if written. FALSE if the ring is full or the message too large.
+	bool Write(UINT32 topic, const void* data, UINT32 size);
+
+	/// Get the oldest published message without removing it. Consumer only.
+	/// @param[out] topic - the message topic.
+	/// @param[out] size - the message size.
+	/// @return The message bytes in the ring or NULL if empty. Valid until Pop().
+	const void* Peek(UINT32& topic, UINT32& size);
+
+	/// Release the message returned by Peek(). Consumer only.
+	void Pop();
+
+	/// Sleep until a message is published, Wake() is called or the timeout
+	/// expires. Consumer only.
+	/// @param[in] timeoutMs - the maximum wait.
+	void Wait(UINT32 timeoutMs);
+
+	/// Wake the consumer.
+	void Wake();
+
+private:
+	ShmRing(const ShmRing&) = delete;
+	ShmRing& operator=(const ShmRing&) = delete;
+
+	struct Header;
+	struct Slot;
+
+	/// Get a slot by position.
+	Slot* GetSlot(UINT64 pos) const;
+
+	/// Map a shared memory object.
+	/// @return TRUE if mapped.
+	bool Map(int fd, size_t size);
+
+	Header* m_header;
+	size_t m_mapSize;
+	std::string m_name;
+	bool m_owner;
+};
+
+#endif
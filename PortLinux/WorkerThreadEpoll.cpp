@@ -0,0 +1,160 @@
+#include "WorkerThreadEpoll.h"
+#include "Fault.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+
+using namespace std;
+
+// Default number of messages processed between descriptor checks
+static const UINT32 DEFAULT_FD_POLL_INTERVAL = 16;
+
+// Maximum number of ready descriptors returned by one epoll_wait() call
+static const int MAX_EVENTS = 16;
+
+//----------------------------------------------------------------------------
+// WorkerThreadEpoll
+//----------------------------------------------------------------------------
+WorkerThreadEpoll::WorkerThreadEpoll(const std::string& threadName) :
+	WorkerThread(threadName),
+	m_epollFd(-1),
+	m_eventFd(-1)
+{
+	m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	ASSERT_TRUE(m_epollFd != -1);
+
+	// The eventfd becomes readable when a message is queued on a parked thread
+	m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ASSERT_TRUE(m_eventFd != -1);
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = m_eventFd;
+	int result = epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_eventFd, &event);
+	ASSERT_TRUE(result == 0);
+
+	SetPollInterval(DEFAULT_FD_POLL_INTERVAL);
+}
+
+//----------------------------------------------------------------------------
+// ~WorkerThreadEpoll
+//----------------------------------------------------------------------------
+WorkerThreadEpoll::~WorkerThreadEpoll()
+{
+	// Exit here while the overridden Park() and Unpark() are still valid
+	ExitThread();
+
+	close(m_eventFd);
+	close(m_epollFd);
+}
+
+//----------------------------------------------------------------------------
+// RegisterFd
+//----------------------------------------------------------------------------
+bool WorkerThreadEpoll::RegisterFd(int fd, UINT32 events, FdCallback callback, void* userData)
+{
+	ASSERT_TRUE(callback != NULL);
+	ASSERT_TRUE(fd != m_eventFd);
+
+	lock_guard<recursive_mutex> lock(m_fdLock);
+
+	epoll_event event = {};
+	event.events = events;
+	event.data.fd = fd;
+
+	// Modify the events if the descriptor is already registered
+	int op = m_fdHandlers.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl(m_epollFd, op, fd, &event) != 0)
+		return false;
+
+	FdHandler handler;
+	handler.Callback = callback;
+	handler.UserData = userData;
+	m_fdHandlers[fd] = handler;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// UnregisterFd
+//----------------------------------------------------------------------------
+bool WorkerThreadEpoll::UnregisterFd(int fd)
+{
+	lock_guard<recursive_mutex> lock(m_fdLock);
+
+	if (m_fdHandlers.erase(fd) == 0)
+		return false;
+
+	// The descriptor may already be closed, so a failure here is ignored
+	epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Park
+//----------------------------------------------------------------------------
+void WorkerThreadEpoll::Park(std::unique_lock<std::mutex>& lk)
+{
+	lk.unlock();
+	WaitEvents(-1);
+	lk.lock();
+}
+
+//----------------------------------------------------------------------------
+// Unpark
+//----------------------------------------------------------------------------
+void WorkerThreadEpoll::Unpark()
+{
+	UINT64 value = 1;
+	ssize_t result = write(m_eventFd, &value, sizeof(value));
+
+	// EAGAIN means the counter is saturated and the thread is already signaled
+	ASSERT_TRUE(result == sizeof(value) || errno == EAGAIN);
+}
+
+//----------------------------------------------------------------------------
+// Poll
+//----------------------------------------------------------------------------
+void WorkerThreadEpoll::Poll()
+{
+	WaitEvents(0);
+}
+
+//----------------------------------------------------------------------------
+// WaitEvents
+//----------------------------------------------------------------------------
+void WorkerThreadEpoll::WaitEvents(int timeoutMs)
+{
+	epoll_event events[MAX_EVENTS];
+	int count = epoll_wait(m_epollFd, events, MAX_EVENTS, timeoutMs);
+
+	// A signal interrupted the wait. Returning is a spurious wakeup.
+	if (count < 0)
+	{
+		ASSERT_TRUE(errno == EINTR);
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		int fd = events[i].data.fd;
+
+		if (fd == m_eventFd)
+		{
+			// Reset the eventfd counter. The queue is checked by the caller.
+			UINT64 value;
+			ssize_t result = read(m_eventFd, &value, sizeof(value));
+			(void)result;
+			continue;
+		}
+
+		// The descriptor may have been unregistered by an earlier callback
+		lock_guard<recursive_mutex> lock(m_fdLock);
+		auto it = m_fdHandlers.find(fd);
+		if (it == m_fdHandlers.end())
+			continue;
+
+		FdHandler handler = it->second;
+		handler.Callback(fd, events[i].events, handler.UserData);
+	}
+}
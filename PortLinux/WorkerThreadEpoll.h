@@ -0,0 +1,81 @@
+#ifndef _WORKER_THREAD_EPOLL_H
+#define _WORKER_THREAD_EPOLL_H
+
+#include "WorkerThreadStd.h"
+#include <map>
+
+/// @brief A Linux WorkerThread that blocks in epoll_wait() instead of on a
+/// condition variable. An eventfd signals the message queue. Clients register
+/// file descriptors (sockets, serial ports, timerfds) with callbacks that
+/// execute on the worker thread, the same thread as the state machines
+/// receiving the thread's async callbacks.
+/// @details Descriptors are serviced whenever the message queue is empty and
+/// every poll interval messages while the queue stays busy.
+class WorkerThreadEpoll : public WorkerThread
+{
+public:
+	/// File descriptor callback function signature
+	/// @param[in] fd - the ready file descriptor.
+	/// @param[in] events - the ready epoll events (EPOLLIN, EPOLLOUT, ...).
+	/// @param[in] userData - the user data passed to RegisterFd().
+	typedef void (*FdCallback)(int fd, UINT32 events, void* userData);
+
+	/// Constructor
+	WorkerThreadEpoll(const std::string& threadName);
+
+	/// Destructor
+	~WorkerThreadEpoll();
+
+	/// Register a file descriptor for readiness callbacks on the worker thread.
+	/// May be called from any thread, including from within a callback.
+	/// @param[in] fd - the file descriptor.
+	/// @param[in] events - the epoll events to wait for.
+	/// @param[in] callback - the function called when the descriptor is ready.
+	/// @param[in] userData - optional user data returned as-is on the callback.
+	/// @return TRUE if registered. FALSE if epoll_ctl() fails.
+	bool RegisterFd(int fd, UINT32 events, FdCallback callback, void* userData = NULL);
+
+	/// Unregister a file descriptor. May be called from any thread. Waits for a
+	/// descriptor callback running on the worker thread to return, so no 
+	/// callbacks for the descriptor occur after this function returns.
+	/// @param[in] fd - the file descriptor.
+	/// @return TRUE if unregistered. FALSE if the descriptor is not registered.
+	bool UnregisterFd(int fd);
+
+	/// Set how many messages are processed between descriptor checks while
+	/// the message queue stays busy.
+	/// @param[in] interval - the message count. 0 services descriptors only
+	///		when the queue is empty.
+	void SetFdPollInterval(UINT32 interval) { SetPollInterval(interval); }
+
+protected:
+	/// @see WorkerThread::Park
+	virtual void Park(std::unique_lock<std::mutex>& lk);
+
+	/// @see WorkerThread::Unpark
+	virtual void Unpark();
+
+	/// @see WorkerThread::Poll
+	virtual void Poll();
+
+private:
+	struct FdHandler
+	{
+		FdCallback Callback;
+		void* UserData;
+	};
+
+	/// Wait on the epoll instance and call any ready descriptor callbacks.
+	/// @param[in] timeoutMs - the epoll_wait() timeout. -1 waits forever.
+	void WaitEvents(int timeoutMs);
+
+	int m_epollFd;
+	int m_eventFd;
+
+	/// Registered descriptors. Guarded by m_fdLock, which is held while a
+	/// descriptor callback runs and may be reacquired by the callback. 
+	std::map<int, FdHandler> m_fdHandlers;
+	std::recursive_mutex m_fdLock;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "Coroutine.h"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <mutex>
+#include <map>
+#include <new>
+#include <cstdint>
+
+using namespace std;
+
+// Frame size classes. Larger frames use the heap directly.
+static const size_t MIN_BLOCK_SIZE = 128;
+static const int SIZE_CLASSES = 6;
+
+// Free blocks per size class, linked through the first word of each block
+static void* freeBlocks[SIZE_CLASSES];
+static size_t freeCounts[SIZE_CLASSES];
+static std::mutex poolLock;
+
+//----------------------------------------------------------------------------
+// SizeClass
+//----------------------------------------------------------------------------
+static int SizeClass(size_t size)
+{
+	size_t blockSize = MIN_BLOCK_SIZE;
+	for (int sizeClass = 0; sizeClass < SIZE_CLASSES; sizeClass++, blockSize *= 2)
+	{
+		if (size <= blockSize)
+			return sizeClass;
+	}
+	return -1;
+}
+
+//----------------------------------------------------------------------------
+// Allocate
+//----------------------------------------------------------------------------
+void* CoroutinePool::Allocate(size_t size)
+{
+	int sizeClass = SizeClass(size);
+	if (sizeClass < 0)
+		return ::operator new(size);
+
+	{
+		lock_guard<mutex> lock(poolLock);
+		void* block = freeBlocks[sizeClass];
+		if (block)
+		{
+			freeBlocks[sizeClass] = *static_cast<void**>(block);
+			freeCounts[sizeClass]--;
+			return block;
+		}
+	}
+	return ::operator new(MIN_BLOCK_SIZE << sizeClass);
+}
+
+//----------------------------------------------------------------------------
+// Deallocate
+//----------------------------------------------------------------------------
+void CoroutinePool::Deallocate(void* frame, size_t size)
+{
+	int sizeClass = SizeClass(size);
+	if (sizeClass < 0)
+	{
+		::operator delete(frame);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(poolLock);
+		if (freeCounts[sizeClass] < MAX_FREE_BLOCKS)
+		{
+			*static_cast<void**>(frame) = freeBlocks[sizeClass];
+			freeBlocks[sizeClass] = frame;
+			freeCounts[sizeClass]++;
+			return;
+		}
+	}
+	::operator delete(frame);
+}
+
+//----------------------------------------------------------------------------
+// CoroutineResumer
+//----------------------------------------------------------------------------
+/// Delivers coroutine resumptions through a CallbackThread queue. The
+/// CallbackMsg data is the coroutine handle address.
+class CoroutineResumer : public AsyncCallbackBase
+{
+public:
+	virtual void TargetInvoke(CallbackMsg** msg) const
+	{
+		void* address = const_cast<void*>((*msg)->GetCallbackData());
+		delete *msg;
+		*msg = NULL;
+		std::coroutine_handle<>::from_address(address).resume();
+	}
+
+	virtual void TargetDiscard(CallbackMsg** msg) const
+	{
+		// The coroutine can't continue so release its frame
+		void* address = const_cast<void*>((*msg)->GetCallbackData());
+		delete *msg;
+		*msg = NULL;
+		std::coroutine_handle<>::from_address(address).destroy();
+	}
+
+	/// Identifies resume messages. Never called.
+	static void Resume(const void* /*data*/, void* /*userData*/) { ASSERT(); }
+};
+
+static CoroutineResumer resumer;
+
+//----------------------------------------------------------------------------
+// PostResume
+//----------------------------------------------------------------------------
+void PostResume(std::coroutine_handle<> handle, CallbackThread& thread)
+{
+	CallbackMsg* msg = new CallbackMsg(&resumer,
+		Callback(&CoroutineResumer::Resume, &thread, NULL, DISPATCH_QUEUED), handle.address());
+	thread.DispatchCallback(msg);
+}
+
+// Waiters registered with a pending AsyncCallback, keyed by ID
+static std::map<UINT64, void*> waiters;
+static UINT64 nextWaiterId = 1;
+static std::mutex waitersLock;
+
+//----------------------------------------------------------------------------
+// Add
+//----------------------------------------------------------------------------
+void* CoroutineWaiters::Add(void* waiter)
+{
+	lock_guard<mutex> lock(waitersLock);
+	UINT64 id = nextWaiterId++;
+	waiters[id] = waiter;
+	return reinterpret_cast<void*>(static_cast<uintptr_t>(id));
+}
+
+//----------------------------------------------------------------------------
+// Remove
+//----------------------------------------------------------------------------
+void* CoroutineWaiters::Remove(void* id)
+{
+	lock_guard<mutex> lock(waitersLock);
+	auto it = waiters.find(reinterpret_cast<uintptr_t>(id));
+	if (it == waiters.end())
+		return NULL;
+	void* waiter = it->second;
+	waiters.erase(it);
+	return waiter;
+}
+
+#endif // __cpp_impl_coroutine
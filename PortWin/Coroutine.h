@@ -0,0 +1,240 @@
+#ifndef _COROUTINE_H
+#define _COROUTINE_H
+
+// C++20 coroutine adapters. Compiled only when the compiler supports
+// coroutines, e.g. GCC 11+ with -std=c++20 or Visual Studio with /std:c++20.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include "AsyncCallback.h"
+#include "StateMachine.h"
+#include "Timer.h"
+#include <coroutine>
+#include <optional>
+#include <chrono>
+
+/// @brief Fixed size block pool for coroutine frames. Frames are recycled by
+/// size class instead of returned to the heap. Each size class keeps at most
+/// MAX_FREE_BLOCKS free frames; frames released beyond that go back to the
+/// heap, so a burst of coroutines doesn't pin its peak memory. Thread-safe,
+/// since a frame may be created on one thread and destroyed on another.
+class CoroutinePool
+{
+public:
+	/// Allocate a frame.
+	/// @param[in] size - the frame size in bytes.
+	/// @return The frame memory.
+	static void* Allocate(size_t size);
+
+	/// Release a frame.
+	/// @param[in] frame - memory returned by Allocate().
+	/// @param[in] size - the size passed to Allocate().
+	static void Deallocate(void* frame, size_t size);
+
+	/// The most free frames retained per size class
+	static const size_t MAX_FREE_BLOCKS = 64;
+};
+
+/// @brief A fire-and-forget coroutine. The coroutine starts running when
+/// called and its frame is released when it finishes.
+/// @details Use co_await ResumeOn() to move the coroutine to a thread, and
+/// the Await functions to suspend until a callback, timer or state change.
+class CoTask
+{
+public:
+	struct promise_type
+	{
+		CoTask get_return_object() { return CoTask(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { ASSERT(); }
+
+		static void* operator new(size_t size) { return CoroutinePool::Allocate(size); }
+		static void operator delete(void* frame, size_t size) { CoroutinePool::Deallocate(frame, size); }
+	};
+};
+
+/// Queue a coroutine resumption onto a thread. The coroutine is destroyed if
+/// the thread rejects the message.
+/// @param[in] handle - the suspended coroutine.
+/// @param[in] thread - the thread to resume on.
+void PostResume(std::coroutine_handle<> handle, CallbackThread& thread);
+
+/// @brief Registry of coroutines waiting on an AsyncCallback. Waiters are
+/// registered by unique ID so a callback queued after the waiter resumed
+/// can't reach a destroyed frame.
+class CoroutineWaiters
+{
+public:
+	/// Add a waiter.
+	/// @return The waiter ID passed as callback user data.
+	static void* Add(void* waiter);
+
+	/// Remove a waiter.
+	/// @param[in] id - the waiter ID.
+	/// @return The waiter or NULL if already removed.
+	static void* Remove(void* id);
+};
+
+/// @brief Awaitable that moves the coroutine onto a thread. Completes
+/// immediately if already executing on the thread.
+class ResumeOnAwaiter
+{
+public:
+	ResumeOnAwaiter(CallbackThread& thread) : m_thread(thread) {}
+	bool await_ready() const { return m_thread.IsCurrentThread(); }
+	void await_suspend(std::coroutine_handle<> handle) { PostResume(handle, m_thread); }
+	void await_resume() {}
+
+private:
+	CallbackThread& m_thread;
+};
+
+/// Resume the coroutine on a thread.
+/// @param[in] thread - the thread to continue on.
+inline ResumeOnAwaiter ResumeOn(CallbackThread& thread)
+{
+	return ResumeOnAwaiter(thread);
+}
+
+/// @brief Awaitable for the next AsyncCallback invocation. The coroutine
+/// resumes on the given thread and co_await yields a copy of the data.
+template <class TData>
+class CallbackAwaiter
+{
+public:
+	CallbackAwaiter(AsyncCallback<TData>& asyncCallback, CallbackThread& thread) :
+		m_asyncCallback(asyncCallback), m_thread(thread) {}
+
+	bool await_ready() const { return false; }
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		m_handle = handle;
+
+		// Always queued so the coroutine resumes from the thread's message loop.
+		// Inline dispatch would resume it nested inside the invoker's Invoke()
+		// call whenever the invoker runs on the resume thread.
+		m_asyncCallback.Register(&Fired, &m_thread, CoroutineWaiters::Add(this), DISPATCH_QUEUED);
+	}
+
+	TData await_resume() { return *m_data; }
+
+private:
+	/// Called on the resume thread for each invocation while registered
+	static void Fired(const TData& data, void* id)
+	{
+		// A later invocation queued before the registration was removed
+		CallbackAwaiter* self = static_cast<CallbackAwaiter*>(CoroutineWaiters::Remove(id));
+		if (self == NULL)
+			return;
+
+		self->m_asyncCallback.Unregister(&Fired, &self->m_thread, id);
+		self->m_data.emplace(data);
+		self->m_handle.resume();
+	}
+
+	AsyncCallback<TData>& m_asyncCallback;
+	CallbackThread& m_thread;
+	std::coroutine_handle<> m_handle;
+	std::optional<TData> m_data;
+};
+
+/// Suspend until an AsyncCallback is invoked.
+/// @param[in] asyncCallback - the callback to wait for.
+/// @param[in] thread - the thread to resume on.
+/// @return An awaitable yielding the callback data.
+template <class TData>
+CallbackAwaiter<TData> AwaitCallback(AsyncCallback<TData>& asyncCallback, CallbackThread& thread)
+{
+	return CallbackAwaiter<TData>(asyncCallback, thread);
+}
+
+/// @brief Awaitable that starts a timer and resumes once it expires. The
+/// timer is stopped on resume.
+class TimerAwaiter
+{
+public:
+	TimerAwaiter(Timer& timer, std::chrono::milliseconds timeout, CallbackThread& thread) :
+		m_timer(timer), m_timeout(timeout), m_expired(timer.Expired, thread) {}
+
+	bool await_ready() const { return false; }
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		// The coroutine may resume on another thread as soon as the timer is
+		// started, so nothing is read from this object afterwards
+		Timer& timer = m_timer;
+		std::chrono::milliseconds timeout = m_timeout;
+		m_expired.await_suspend(handle);
+		timer.Start(timeout);
+	}
+
+	void await_resume() { m_timer.Stop(); }
+
+private:
+	Timer& m_timer;
+	std::chrono::milliseconds m_timeout;
+	CallbackAwaiter<NoData> m_expired;
+};
+
+/// Suspend for a timeout using a timer. The timer must outlive the wait.
+/// @param[in] timer - a timer not used for anything else while waiting.
+/// @param[in] timeout - the time to wait.
+/// @param[in] thread - the thread to resume on.
+inline TimerAwaiter AwaitTimer(Timer& timer, std::chrono::milliseconds timeout, CallbackThread& thread)
+{
+	return TimerAwaiter(timer, timeout, thread);
+}
+
+/// @brief Awaitable for a state machine entering a state. The coroutine
+/// resumes on the given thread after the state action completes when that
+/// thread is the machine's thread. Uses the machine's single state observer.
+class StateAwaiter
+{
+public:
+	StateAwaiter(StateMachine& sm, BYTE state, CallbackThread& thread) :
+		m_sm(sm), m_state(state), m_thread(thread) {}
+
+	bool await_ready() const { return false; }
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		m_handle = handle;
+		bool installed = m_sm.SetStateObserver(&Observed, this);
+		ASSERT_TRUE(installed);
+	}
+
+	void await_resume() {}
+
+private:
+	/// Called on the state machine thread for each state entered
+	static void Observed(StateMachine* sm, BYTE state, void* userData)
+	{
+		StateAwaiter* self = static_cast<StateAwaiter*>(userData);
+		if (state != self->m_state)
+			return;
+
+		sm->ClearStateObserver();
+		PostResume(self->m_handle, self->m_thread);
+	}
+
+	StateMachine& m_sm;
+	BYTE m_state;
+	CallbackThread& m_thread;
+	std::coroutine_handle<> m_handle;
+};
+
+/// Suspend until a state machine enters a state.
+/// @param[in] sm - the state machine. Only one coroutine may wait on a
+///		machine at a time.
+/// @param[in] state - the state to wait for.
+/// @param[in] thread - the thread to resume on.
+inline StateAwaiter AwaitState(StateMachine& sm, BYTE state, CallbackThread& thread)
+{
+	return StateAwaiter(sm, state, thread);
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif
@@ -0,0 +1,120 @@
+#include "CpuAccounting.h"
+#include <algorithm>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// CpuAccounting
+//----------------------------------------------------------------------------
+CpuAccounting::CpuAccounting() :
+	m_sampleInterval(0),
+	m_skipped(0)
+{
+}
+
+//----------------------------------------------------------------------------
+// Record
+//----------------------------------------------------------------------------
+void CpuAccounting::Record(Callback::CallbackFunc func, const CallbackTarget* asyncCallback,
+	UINT64 cpuNs, UINT64 wallNs)
+{
+	lock_guard<mutex> lock(m_lock);
+
+	if (func != NULL)
+	{
+		CpuUsage& byFunc = m_functions[func];
+		byFunc.func = func;
+		byFunc.asyncCallback = NULL;
+		byFunc.samples++;
+		byFunc.cpuNs += cpuNs;
+		byFunc.wallNs += wallNs;
+	}
+
+	CpuUsage& byAsync = m_asyncCallbacks[asyncCallback];
+	byAsync.func = NULL;
+	byAsync.asyncCallback = asyncCallback;
+	byAsync.samples++;
+	byAsync.cpuNs += cpuNs;
+	byAsync.wallNs += wallNs;
+}
+
+//----------------------------------------------------------------------------
+// GetTopFunctions
+//----------------------------------------------------------------------------
+std::vector<CpuUsage> CpuAccounting::GetTopFunctions(size_t count)
+{
+	std::vector<CpuUsage> usage;
+	{
+		lock_guard<mutex> lock(m_lock);
+		for (const auto& entry : m_functions)
+			usage.push_back(entry.second);
+	}
+	return Top(usage, count);
+}
+
+//----------------------------------------------------------------------------
+// GetTopAsyncCallbacks
+//----------------------------------------------------------------------------
+std::vector<CpuUsage> CpuAccounting::GetTopAsyncCallbacks(size_t count)
+{
+	std::vector<CpuUsage> usage;
+	{
+		lock_guard<mutex> lock(m_lock);
+		for (const auto& entry : m_asyncCallbacks)
+			usage.push_back(entry.second);
+	}
+	return Top(usage, count);
+}
+
+//----------------------------------------------------------------------------
+// Top
+//----------------------------------------------------------------------------
+std::vector<CpuUsage> CpuAccounting::Top(std::vector<CpuUsage>& usage, size_t count)
+{
+	std::sort(usage.begin(), usage.end(),
+		[](const CpuUsage& a, const CpuUsage& b) { return a.cpuNs > b.cpuNs; });
+	if (usage.size() > count)
+		usage.resize(count);
+	return usage;
+}
+
+//----------------------------------------------------------------------------
+// Reset
+//----------------------------------------------------------------------------
+void CpuAccounting::Reset()
+{
+	lock_guard<mutex> lock(m_lock);
+	m_functions.clear();
+	m_asyncCallbacks.clear();
+}
+
+//----------------------------------------------------------------------------
+// GetThreadCpuNs
+//----------------------------------------------------------------------------
+UINT64 CpuAccounting::GetThreadCpuNs()
+{
+#ifdef WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		return 0;
+	ULARGE_INTEGER kernelTime, userTime;
+	kernelTime.LowPart = kernel.dwLowDateTime;
+	kernelTime.HighPart = kernel.dwHighDateTime;
+	userTime.LowPart = user.dwLowDateTime;
+	userTime.HighPart = user.dwHighDateTime;
+
+	// FILETIME is in 100 nanosecond units
+	return (kernelTime.QuadPart + userTime.QuadPart) * 100;
+#else
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return 0;
+	return static_cast<UINT64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
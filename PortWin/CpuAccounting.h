@@ -0,0 +1,102 @@
+#ifndef _CPU_ACCOUNTING_H
+#define _CPU_ACCOUNTING_H
+
+#include "Callback.h"
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
+
+class CallbackTarget;
+
+/// @brief Time attributed to one callback function or AsyncCallback instance.
+struct CpuUsage
+{
+	/// The callback function or NULL when aggregated per AsyncCallback
+	Callback::CallbackFunc func;
+
+	/// The AsyncCallback instance or other message target, or NULL when 
+	/// aggregated per function. Only used as an identity and may no longer
+	/// exist.
+	const CallbackTarget* asyncCallback;
+
+	/// Number of sampled invocations
+	UINT64 samples;
+
+	/// Thread CPU time of the sampled invocations
+	UINT64 cpuNs;
+
+	/// Wall time of the sampled invocations
+	UINT64 wallNs;
+};
+
+/// @brief Attributes a thread's callback CPU and wall time to callback
+/// functions and AsyncCallback instances.
+/// @details Disabled by default. With a sample interval of N, one callback in
+/// N is timed, so totals are scaled down by N. The owning thread updates the
+/// totals and reports may be read from any thread.
+class CpuAccounting
+{
+public:
+	/// Constructor
+	CpuAccounting();
+
+	/// Set how often callbacks are timed. May be called from any thread.
+	/// @param[in] interval - time one callback in interval. 1 times every
+	///		callback. 0 disables accounting.
+	void SetSampleInterval(UINT32 interval) { m_sampleInterval = interval; }
+
+	/// Get the sample interval.
+	UINT32 GetSampleInterval() const { return m_sampleInterval; }
+
+	/// Called by the owning thread before each callback.
+	/// @return TRUE if this callback should be timed.
+	bool ShouldSample()
+	{
+		UINT32 interval = m_sampleInterval.load(std::memory_order_relaxed);
+		if (interval == 0 || ++m_skipped < interval)
+			return false;
+		m_skipped = 0;
+		return true;
+	}
+
+	/// Add a timed callback to the totals.
+	/// @param[in] func - the callback function, or NULL for work such as 
+	///		fan-out that is only credited to the AsyncCallback.
+	/// @param[in] asyncCallback - the AsyncCallback the callback is registered with.
+	/// @param[in] cpuNs - the thread CPU time consumed.
+	/// @param[in] wallNs - the wall time elapsed.
+	void Record(Callback::CallbackFunc func, const CallbackTarget* asyncCallback,
+		UINT64 cpuNs, UINT64 wallNs);
+
+	/// Get the callback functions with the most CPU time, highest first.
+	/// @param[in] count - the maximum number of entries returned.
+	std::vector<CpuUsage> GetTopFunctions(size_t count);
+
+	/// Get the AsyncCallback instances with the most CPU time, highest first.
+	/// @param[in] count - the maximum number of entries returned.
+	std::vector<CpuUsage> GetTopAsyncCallbacks(size_t count);
+
+	/// Clear the totals.
+	void Reset();
+
+	/// Get the CPU time consumed by the calling thread.
+	/// @return The thread CPU time in nanoseconds.
+	static UINT64 GetThreadCpuNs();
+
+private:
+	/// Sort usage by CPU time and keep the top entries.
+	static std::vector<CpuUsage> Top(std::vector<CpuUsage>& usage, size_t count);
+
+	std::atomic<UINT32> m_sampleInterval;
+
+	/// Callbacks since the last sample. Only accessed by the owning thread.
+	UINT32 m_skipped;
+
+	/// Totals. Guarded by m_lock.
+	std::map<Callback::CallbackFunc, CpuUsage> m_functions;
+	std::map<const CallbackTarget*, CpuUsage> m_asyncCallbacks;
+	std::mutex m_lock;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "DeterministicExecutor.h"
+#include "AsyncCallbackBase.h"
+#include "Timer.h"
+
+using namespace std;
+
+std::atomic<INT64> DeterministicExecutor::m_time(0);
+
+// The executor whose callback the calling thread is running, if any
+static thread_local const DeterministicExecutor* currentExecutor = NULL;
+
+//----------------------------------------------------------------------------
+// DeterministicExecutor
+//----------------------------------------------------------------------------
+DeterministicExecutor::DeterministicExecutor(const std::string& name) :
+	m_dispatchCount(0),
+	m_expired(0),
+	EXECUTOR_NAME(name)
+{
+}
+
+//----------------------------------------------------------------------------
+// ~DeterministicExecutor
+//----------------------------------------------------------------------------
+DeterministicExecutor::~DeterministicExecutor()
+{
+	CallbackMsg* msg;
+	while ((msg = PopNextMsg()) != NULL)
+		msg->GetAsyncCallback()->TargetDiscard(&msg);
+}
+
+//----------------------------------------------------------------------------
+// IsCurrentThread
+//----------------------------------------------------------------------------
+bool DeterministicExecutor::IsCurrentThread() const
+{
+	return currentExecutor == this;
+}
+
+//----------------------------------------------------------------------------
+// DispatchCallback
+//----------------------------------------------------------------------------
+bool DeterministicExecutor::DispatchCallback(CallbackMsg* msg)
+{
+	// Defer a callback dispatched by a running callback
+	if (IsCurrentThread() &&
+		msg->GetAsyncCallback()->GetDispatchPolicy(*msg->GetCallback()) == DISPATCH_DEFERRED)
+	{
+		m_deferred.push_back(msg);
+		return true;
+	}
+
+	lock_guard<mutex> lock(m_mutex);
+	m_queue[msg->GetPriority()].push_back(msg);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// GetQueueDepth
+//----------------------------------------------------------------------------
+size_t DeterministicExecutor::GetQueueDepth()
+{
+	lock_guard<mutex> lock(m_mutex);
+	size_t depth = 0;
+	for (int lane = 0; lane < PRIORITY_LANES; lane++)
+		depth += m_queue[lane].size();
+	return depth;
+}
+
+//----------------------------------------------------------------------------
+// PopNextMsg
+//----------------------------------------------------------------------------
+CallbackMsg* DeterministicExecutor::PopNextMsg()
+{
+	lock_guard<mutex> lock(m_mutex);
+	for (int lane = 0; lane < PRIORITY_LANES; lane++)
+	{
+		if (!m_queue[lane].empty())
+		{
+			CallbackMsg* msg = m_queue[lane].front();
+			m_queue[lane].pop_front();
+			return msg;
+		}
+	}
+	return NULL;
+}
+
+//----------------------------------------------------------------------------
+// InvokeCallback
+//----------------------------------------------------------------------------
+size_t DeterministicExecutor::InvokeCallback(CallbackMsg* msg)
+{
+	const DeterministicExecutor* previous = currentExecutor;
+	currentExecutor = this;
+
+	size_t count = 0;
+	m_deferred.push_back(msg);
+
+	// Deferred callbacks may defer further callbacks, which run in turn
+	while (!m_deferred.empty())
+	{
+		CallbackMsg* callbackMsg = m_deferred.front();
+		m_deferred.pop_front();
+
+		// Discard a stale message without running the target
+		if (callbackMsg->IsExpired())
+		{
+			callbackMsg->GetAsyncCallback()->TargetDiscard(&callbackMsg);
+			m_expired++;
+			continue;
+		}
+
+		callbackMsg->GetAsyncCallback()->TargetInvoke(&callbackMsg);
+		m_dispatchCount++;
+		count++;
+	}
+
+	currentExecutor = previous;
+	return count;
+}
+
+//----------------------------------------------------------------------------
+// RunIdle
+//----------------------------------------------------------------------------
+bool DeterministicExecutor::RunIdle(DoneFunc done, void* userData, size_t& count)
+{
+	for (;;)
+	{
+		if (done != NULL && (*done)(userData))
+			return true;
+
+		CallbackMsg* msg = PopNextMsg();
+		if (msg == NULL)
+		{
+			// Expired timers may dispatch more callbacks
+			Timer::ProcessTimers();
+			msg = PopNextMsg();
+			if (msg == NULL)
+				return false;
+		}
+		count += InvokeCallback(msg);
+	}
+}
+
+//----------------------------------------------------------------------------
+// Run
+//----------------------------------------------------------------------------
+bool DeterministicExecutor::Run(DoneFunc done, void* userData, std::chrono::milliseconds limit, size_t& count)
+{
+	// A callback can't run the executor it is running on
+	ASSERT_TRUE(!IsCurrentThread());
+
+	const std::chrono::milliseconds endTime = GetTime() + limit;
+	for (;;)
+	{
+		if (RunIdle(done, userData, count))
+			return true;
+
+		// Jump to the next timer expiration. Expired timers were serviced by
+		// RunIdle() so the next expiration is always in the future.
+		std::chrono::milliseconds expireTime;
+		if (!Timer::GetNextExpiration(expireTime) || expireTime > endTime)
+			break;
+		SetTime(expireTime);
+	}
+
+	SetTime(endTime);
+	return RunIdle(done, userData, count);
+}
+
+//----------------------------------------------------------------------------
+// RunUntilIdle
+//----------------------------------------------------------------------------
+size_t DeterministicExecutor::RunUntilIdle()
+{
+	ASSERT_TRUE(!IsCurrentThread());
+
+	size_t count = 0;
+	RunIdle(NULL, NULL, count);
+	return count;
+}
+
+//----------------------------------------------------------------------------
+// RunFor
+//----------------------------------------------------------------------------
+size_t DeterministicExecutor::RunFor(std::chrono::milliseconds duration)
+{
+	size_t count = 0;
+	Run(NULL, NULL, duration, count);
+	return count;
+}
+
+//----------------------------------------------------------------------------
+// RunUntil
+//----------------------------------------------------------------------------
+bool DeterministicExecutor::RunUntil(DoneFunc done, void* userData, std::chrono::milliseconds limit)
+{
+	ASSERT_TRUE(done != NULL);
+
+	size_t count = 0;
+	return Run(done, userData, limit, count);
+}
+
+//----------------------------------------------------------------------------
+// GetTime
+//----------------------------------------------------------------------------
+std::chrono::milliseconds DeterministicExecutor::GetTime()
+{
+	return std::chrono::milliseconds(m_time.load());
+}
+
+//----------------------------------------------------------------------------
+// SetTime
+//----------------------------------------------------------------------------
+void DeterministicExecutor::SetTime(std::chrono::milliseconds time)
+{
+	m_time = time.count();
+}
@@ -0,0 +1,124 @@
+#ifndef _DETERMINISTIC_EXECUTOR_H
+#define _DETERMINISTIC_EXECUTOR_H
+
+#include "CallbackThread.h"
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/// @brief A CallbackThread that runs callbacks on the caller's thread when
+/// one of the Run functions is called, for tests and benchmarks. Stands in
+/// for a WorkerThread so state machines run without real threads or delays.
+/// @details Time is simulated. Install the simulated clock with
+/// Timer::SetClock(&DeterministicExecutor::GetTime) before starting timers.
+/// Once the queue is empty, RunFor() jumps the clock straight to the next
+/// timer expiration, so a run taking minutes of timer time completes in
+/// microseconds and replays identically every time. The clock is shared by
+/// every executor and timer in the process.
+///
+/// Callbacks may be dispatched from any thread, but only run within a Run
+/// call. Priority lanes are drained strictly. DISPATCH_DEFERRED callbacks
+/// dispatched from a running callback run after it returns.
+class DeterministicExecutor : public CallbackThread
+{
+public:
+	/// A predicate that ends RunUntil().
+	/// @param[in] userData - the user data passed to RunUntil().
+	/// @return TRUE to stop running.
+	typedef bool (*DoneFunc)(void* userData);
+
+	/// Constructor
+	/// @param[in] name - the executor name.
+	DeterministicExecutor(const std::string& name);
+
+	/// Destructor. Queued messages are discarded.
+	~DeterministicExecutor();
+
+	/// Get the executor name
+	const std::string& GetThreadName() const { return EXECUTOR_NAME; }
+
+	/// @see CallbackThread::DispatchCallback
+	virtual bool DispatchCallback(CallbackMsg* msg);
+
+	/// @see CallbackThread::IsCurrentThread
+	/// @return TRUE if called from a callback run by this executor.
+	virtual bool IsCurrentThread() const;
+
+	/// Run queued callbacks and expired timers without advancing time.
+	/// @return The number of callbacks invoked.
+	size_t RunUntilIdle();
+
+	/// Run callbacks and timers while advancing the simulated time.
+	/// @param[in] duration - the simulated time to advance.
+	/// @return The number of callbacks invoked.
+	size_t RunFor(std::chrono::milliseconds duration);
+
+	/// Run callbacks and timers until a predicate is satisfied, advancing
+	/// the simulated time as required.
+	/// @param[in] done - checked after each callback.
+	/// @param[in] userData - optional user data passed to done.
+	/// @param[in] limit - the most simulated time to advance.
+	/// @return TRUE if done, FALSE if the limit was reached or the executor
+	///		ran out of work first.
+	bool RunUntil(DoneFunc done, void* userData, std::chrono::milliseconds limit);
+
+	/// Get the number of messages in the queue.
+	size_t GetQueueDepth();
+
+	/// Get the number of callbacks invoked.
+	UINT64 GetDispatchCount() const { return m_dispatchCount; }
+
+	/// Get the number of messages discarded because their deadline passed.
+	UINT32 GetExpiredCount() const { return m_expired; }
+
+	/// Get the simulated time. Pass to Timer::SetClock().
+	/// @return The simulated time in ticks.
+	static std::chrono::milliseconds GetTime();
+
+	/// Set the simulated time, for instance to replay a run from the start.
+	/// @param[in] time - the new simulated time in ticks.
+	static void SetTime(std::chrono::milliseconds time);
+
+private:
+	DeterministicExecutor(const DeterministicExecutor&) = delete;
+	DeterministicExecutor& operator=(const DeterministicExecutor&) = delete;
+
+	/// Remove the next message in priority order.
+	/// @return The message or NULL if the queue is empty.
+	CallbackMsg* PopNextMsg();
+
+	/// Invoke a callback and any callbacks it deferred.
+	/// @return The number of callbacks invoked.
+	size_t InvokeCallback(CallbackMsg* msg);
+
+	/// Run queued callbacks and expired timers at the current time.
+	/// @param[in] done - optional predicate checked after each callback.
+	/// @param[in] userData - user data passed to done.
+	/// @param[in,out] count - incremented for each callback invoked.
+	/// @return TRUE if done was satisfied.
+	bool RunIdle(DoneFunc done, void* userData, size_t& count);
+
+	/// Run callbacks, jumping the simulated time to each timer expiration
+	/// up to the limit.
+	/// @return TRUE if done was satisfied.
+	bool Run(DoneFunc done, void* userData, std::chrono::milliseconds limit, size_t& count);
+
+	/// Message queue per priority lane. Guarded by m_mutex.
+	std::deque<CallbackMsg*> m_queue[PRIORITY_LANES];
+	std::mutex m_mutex;
+
+	/// Deferred callbacks. Only accessed while running.
+	std::deque<CallbackMsg*> m_deferred;
+
+	std::atomic<UINT64> m_dispatchCount;
+	std::atomic<UINT32> m_expired;
+
+	/// The simulated time in milliseconds
+	static std::atomic<INT64> m_time;
+
+	const std::string EXECUTOR_NAME;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "LatencyHistogram.h"
+#include "Fault.h"
+
+//----------------------------------------------------------------------------
+// Increment
+//----------------------------------------------------------------------------
+static inline void Increment(std::atomic<UINT64>& value, UINT64 amount)
+{
+	// Single writer so a load and store avoids a locked read-modify-write
+	value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// LatencyHistogram
+//----------------------------------------------------------------------------
+LatencyHistogram::LatencyHistogram() :
+	m_count(0),
+	m_totalNs(0),
+	m_maxNs(0)
+{
+	for (int bucket = 0; bucket < BUCKETS; bucket++)
+		m_buckets[bucket] = 0;
+}
+
+//----------------------------------------------------------------------------
+// Record
+//----------------------------------------------------------------------------
+void LatencyHistogram::Record(UINT64 ns)
+{
+	// Find the bucket using the position of the most significant bit
+	int bucket = 0;
+	UINT64 value = ns;
+	while (value > 1 && bucket < BUCKETS - 1)
+	{
+		value >>= 1;
+		bucket++;
+	}
+
+	Increment(m_buckets[bucket], 1);
+	Increment(m_count, 1);
+	Increment(m_totalNs, ns);
+	if (ns > m_maxNs.load(std::memory_order_relaxed))
+		m_maxNs.store(ns, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// GetBucketCount
+//----------------------------------------------------------------------------
+UINT64 LatencyHistogram::GetBucketCount(int bucket) const
+{
+	ASSERT_TRUE(bucket >= 0 && bucket < BUCKETS);
+	return m_buckets[bucket].load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// GetBucketLimitNs
+//----------------------------------------------------------------------------
+UINT64 LatencyHistogram::GetBucketLimitNs(int bucket)
+{
+	ASSERT_TRUE(bucket >= 0 && bucket < BUCKETS);
+	return static_cast<UINT64>(1) << (bucket + 1);
+}
+
+//----------------------------------------------------------------------------
+// GetPercentileNs
+//----------------------------------------------------------------------------
+UINT64 LatencyHistogram::GetPercentileNs(double percentile) const
+{
+	UINT64 counts[BUCKETS];
+	UINT64 total = 0;
+	for (int bucket = 0; bucket < BUCKETS; bucket++)
+	{
+		counts[bucket] = GetBucketCount(bucket);
+		total += counts[bucket];
+	}
+	if (total == 0)
+		return 0;
+
+	// Walk the buckets until the requested share of durations is covered
+	UINT64 target = static_cast<UINT64>(total * percentile / 100.0);
+	UINT64 covered = 0;
+	for (int bucket = 0; bucket < BUCKETS; bucket++)
+	{
+		covered += counts[bucket];
+		if (covered >= target && covered != 0)
+			return GetBucketLimitNs(bucket);
+	}
+	return GetBucketLimitNs(BUCKETS - 1);
+}
@@ -0,0 +1,60 @@
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include "DataTypes.h"
+#include <atomic>
+
+/// @brief A histogram of durations using power of two nanosecond buckets. 
+/// Bucket N counts durations from 2^N up to 2^(N+1) nanoseconds. Bucket 0 also 
+/// counts durations under 1 nanosecond and the last bucket counts all longer 
+/// durations. A single thread calls Record(). Any thread may read the histogram
+/// without locking. 
+class LatencyHistogram
+{
+public:
+	enum { BUCKETS = 32 };
+
+	/// Constructor
+	LatencyHistogram();
+
+	/// Add a duration to the histogram. 
+	/// @param[in] ns - the duration in nanoseconds.
+	/// @pre Only one thread calls Record().
+	void Record(UINT64 ns);
+
+	/// Get the number of durations recorded in a bucket.
+	/// @param[in] bucket - the bucket index.
+	/// @return The bucket count.
+	UINT64 GetBucketCount(int bucket) const;
+
+	/// Get the exclusive upper bound of a bucket.
+	/// @param[in] bucket - the bucket index.
+	/// @return The bucket upper bound in nanoseconds.
+	static UINT64 GetBucketLimitNs(int bucket);
+
+	/// Get the total number of durations recorded.
+	UINT64 GetCount() const { return m_count.load(std::memory_order_relaxed); }
+
+	/// Get the sum of all durations recorded.
+	UINT64 GetTotalNs() const { return m_totalNs.load(std::memory_order_relaxed); }
+
+	/// Get the longest duration recorded.
+	UINT64 GetMaxNs() const { return m_maxNs.load(std::memory_order_relaxed); }
+
+	/// Estimate a percentile from the bucket counts.
+	/// @param[in] percentile - the percentile from 0 to 100.
+	/// @return The upper bound of the bucket holding the percentile in 
+	///		nanoseconds, or 0 if nothing has been recorded. 
+	UINT64 GetPercentileNs(double percentile) const;
+
+private:
+	LatencyHistogram(const LatencyHistogram&);
+	LatencyHistogram& operator=(const LatencyHistogram&);
+
+	std::atomic<UINT64> m_buckets[BUCKETS];
+	std::atomic<UINT64> m_count;
+	std::atomic<UINT64> m_totalNs;
+	std::atomic<UINT64> m_maxNs;
+};
+
+#endif
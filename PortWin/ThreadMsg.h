@@ -24,9 +24,22 @@ public:
 	INT GetId() const { return m_id; } 
 	void* GetData() const { return m_data; } 
 
+#ifdef WORKER_THREAD_METRICS
+	/// Set the time the message was added to the thread queue.
+	/// @param[in] ns - the steady clock time in nanoseconds.
+	void SetEnqueueTime(INT64 ns) { m_enqueueNs = ns; }
+
+	/// Get the time the message was added to the thread queue.
+	INT64 GetEnqueueTime() const { return m_enqueueNs; }
+#endif
+
 private:
 	INT m_id;
 	void* m_data;
+
+#ifdef WORKER_THREAD_METRICS
+	INT64 m_enqueueNs = 0;
+#endif
 };
 
 #endif
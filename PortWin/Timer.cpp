@@ -6,8 +6,11 @@
 using namespace std;
 
 std::mutex Timer::m_lock;
+std::recursive_mutex Timer::m_dispatchLock;
 bool Timer::m_timerStopped = false;
 list<Timer*> Timer::m_timers;
+list<Timer*> Timer::m_expired;
+std::atomic<Timer::ClockFunc> Timer::m_clock(NULL);
 
 //------------------------------------------------------------------------------
 // TimerDisabled
@@ -22,6 +25,11 @@ static bool TimerDisabled (Timer* value)
 //------------------------------------------------------------------------------
 Timer::Timer() 
 {
+	// ProcessTimers() dispatches holding m_dispatchLock. Blocking on a full
+	// queue would stall timers destroyed on other threads, so an expiration
+	// that doesn't fit is dropped and the next interval delivers.
+	Expired.SetOverflowPolicy(OVERFLOW_DROP_NEWEST);
+
 	const std::lock_guard<std::mutex> lock(m_lock);
 	m_enabled = false;
 }
@@ -31,8 +39,11 @@ Timer::Timer()
 //------------------------------------------------------------------------------
 Timer::~Timer()
 {
+	// Wait for expirations being dispatched by other threads
+	const std::lock_guard<std::recursive_mutex> dispatchLock(m_dispatchLock);
 	const std::lock_guard<std::mutex> lock(m_lock);
 	m_timers.remove(this);
+	m_expired.remove(this);
 }
 
 //------------------------------------------------------------------------------
@@ -68,14 +79,14 @@ void Timer::Stop()
 //------------------------------------------------------------------------------
 // CheckExpired
 //------------------------------------------------------------------------------
-void Timer::CheckExpired()
+bool Timer::CheckExpired()
 {
 	if (!m_enabled)
-		return;
+		return false;
 
 	// Has the timer expired?
     if (Difference(m_expireTime, GetTime()) < m_timeout)
-        return;
+        return false;
 
     // Increment the timer to the next expiration
 	m_expireTime += m_timeout;
@@ -86,10 +97,7 @@ void Timer::CheckExpired()
 		// The timer has fallen behind so set time expiration further forward.
 		m_expireTime = GetTime();
 	}
-
-	// Call the client's expired callback function
-	if (Expired)
-		Expired(NoData());
+	return true;
 }
 
 //------------------------------------------------------------------------------
@@ -105,26 +113,86 @@ std::chrono::milliseconds Timer::Difference(std::chrono::milliseconds time1, std
 //------------------------------------------------------------------------------
 void Timer::ProcessTimers()
 {
-	const std::lock_guard<std::mutex> lock(m_lock);
+	const std::lock_guard<std::recursive_mutex> dispatchLock(m_dispatchLock);
+	{
+		const std::lock_guard<std::mutex> lock(m_lock);
+
+		// Remove disabled timer from the list if stopped
+		if (m_timerStopped)
+		{
+			m_timers.remove_if(TimerDisabled);
+			m_timerStopped = false;
+		}
+
+		// Iterate through each timer and check for expirations
+		TimersIterator it;
+		for (it = m_timers.begin() ; it != m_timers.end(); it++ )
+		{
+			if ((*it) != NULL && (*it)->CheckExpired())
+				m_expired.push_back(*it);
+		}
+	}
 
-	// Remove disabled timer from the list if stopped
-	if (m_timerStopped)
+	// Call the clients' expired callback functions without holding m_lock, 
+	// so a DISPATCH_INLINE handler may call Start(), Stop() or destroy a timer
+	while (true)
 	{
-		m_timers.remove_if(TimerDisabled);
-		m_timerStopped = false;
+		Timer* timer;
+		{
+			const std::lock_guard<std::mutex> lock(m_lock);
+			if (m_expired.empty())
+				break;
+			timer = m_expired.front();
+			m_expired.pop_front();
+
+			// Stopped by a handler called earlier in this pass
+			if (!timer->m_enabled)
+				continue;
+		}
+
+		if (timer->Expired)
+			timer->Expired(NoData());
 	}
+}
+
+//------------------------------------------------------------------------------
+// GetNextExpiration
+//------------------------------------------------------------------------------
+bool Timer::GetNextExpiration(std::chrono::milliseconds& expireTime)
+{
+	const std::lock_guard<std::mutex> lock(m_lock);
 
-	// Iterate through each timer and check for expirations
-	TimersIterator it;
-	for (it = m_timers.begin() ; it != m_timers.end(); it++ )
+	bool found = false;
+	for (TimersIterator it = m_timers.begin(); it != m_timers.end(); it++)
 	{
-		if ((*it) != NULL)
-			(*it)->CheckExpired();
+		if ((*it) == NULL || !(*it)->m_enabled)
+			continue;
+
+		std::chrono::milliseconds timerExpireTime = (*it)->m_expireTime + (*it)->m_timeout;
+		if (!found || timerExpireTime < expireTime)
+			expireTime = timerExpireTime;
+		found = true;
 	}
+	return found;
+}
+
+//------------------------------------------------------------------------------
+// SetClock
+//------------------------------------------------------------------------------
+void Timer::SetClock(ClockFunc clock)
+{
+	m_clock = clock;
 }
 
+//------------------------------------------------------------------------------
+// GetTime
+//------------------------------------------------------------------------------
 std::chrono::milliseconds Timer::GetTime()
 {
+	ClockFunc clock = m_clock;
+	if (clock != NULL)
+		return (*clock)();
+
 	auto duration = std::chrono::system_clock::now().time_since_epoch();
 	auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
 	return millis;
@@ -4,15 +4,22 @@
 #include "AsyncCallback.h"
 #include <mutex>
 #include <list>
+#include <atomic>
 
 /// @brief A timer class provides periodic timer callbacks on the client's 
 /// thread of control. Timer is thread safe.
 class Timer 
 {
 public:
-	/// An expired callback client's register with to get callbacks
+	/// An expired callback client's register with to get callbacks. Invoked
+	/// without holding the timer lock, so a handler may call Start() or Stop().
+	/// Uses OVERFLOW_DROP_NEWEST so the timer thread never blocks on a full 
+	/// queue. Don't change it to OVERFLOW_BLOCK.
 	AsyncCallback<> Expired;
 
+	/// A clock function returning the current time in ticks.
+	typedef std::chrono::milliseconds (*ClockFunc)();
+
 	/// Constructor
 	Timer(void);
 
@@ -34,6 +41,17 @@ public:
 	/// @return The current time in ticks. 
     static std::chrono::milliseconds GetTime();
 
+	/// Replace the clock used by all timers, for instance with simulated time.
+	/// Install the clock before starting timers since expirations already
+	/// scheduled are not converted.
+	/// @param[in] clock - the clock function, or NULL for the system clock.
+	static void SetClock(ClockFunc clock);
+
+	/// Get the earliest expiration time of all enabled timers.
+	/// @param[out] expireTime - the next expiration time in ticks.
+	/// @return TRUE if a timer is enabled, FALSE otherwise.
+	static bool GetNextExpiration(std::chrono::milliseconds& expireTime);
+
 	/// Computes the time difference in ticks between two tick values taking into
 	/// account rollover.
 	/// @param[in] 	time1 - time stamp 1 in ticks.
@@ -49,20 +67,31 @@ private:
 	Timer(const Timer&);
 	Timer& operator=(const Timer&);
 
-	/// Called to check for expired timers and callback registered clients.
-	void CheckExpired();
+	/// Called to check for an expired timer and schedule the next expiration.
+	/// @return TRUE if the timer expired. 
+	bool CheckExpired();
 
 	/// List of all system timers to be serviced.
 	static std::list<Timer*> m_timers;
 	typedef std::list<Timer*>::iterator TimersIterator;
 
+	/// Expired timers waiting for ProcessTimers() to call their clients.
+	static std::list<Timer*> m_expired;
+
 	/// A lock to make this class thread safe.
 	static std::mutex m_lock;
 
+	/// Held while ProcessTimers() calls clients so a timer isn't destroyed 
+	/// by another thread mid-call. Recursive so a handler may destroy a timer.
+	static std::recursive_mutex m_dispatchLock;
+
 	std::chrono::milliseconds m_timeout = std::chrono::milliseconds(0);		
 	std::chrono::milliseconds m_expireTime = std::chrono::milliseconds(0);
 	bool m_enabled = false;
 	static bool m_timerStopped;
+
+	/// The installed clock or NULL for the system clock.
+	static std::atomic<ClockFunc> m_clock;
 };
 
 #endif
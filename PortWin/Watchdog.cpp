@@ -0,0 +1,175 @@
+#include "Watchdog.h"
+#include <chrono>
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// NowNs
+//----------------------------------------------------------------------------
+static inline INT64 NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//----------------------------------------------------------------------------
+// Watchdog
+//----------------------------------------------------------------------------
+Watchdog::Watchdog() :
+	m_exit(false),
+	m_checkIntervalMs(0)
+{
+}
+
+//----------------------------------------------------------------------------
+// ~Watchdog
+//----------------------------------------------------------------------------
+Watchdog::~Watchdog()
+{
+	Stop();
+}
+
+//----------------------------------------------------------------------------
+// Start
+//----------------------------------------------------------------------------
+void Watchdog::Start(UINT32 checkIntervalMs)
+{
+	ASSERT_TRUE(checkIntervalMs != 0);
+
+	if (m_thread.joinable())
+		return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_exit = false;
+		m_checkIntervalMs = checkIntervalMs;
+	}
+	m_thread = std::thread(&Watchdog::Process, this);
+}
+
+//----------------------------------------------------------------------------
+// Stop
+//----------------------------------------------------------------------------
+void Watchdog::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_exit = true;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+//----------------------------------------------------------------------------
+// Add
+//----------------------------------------------------------------------------
+void Watchdog::Add(const WorkerThread& thread, UINT32 budgetMs)
+{
+	lock_guard<mutex> lock(m_mutex);
+	for (Entry& entry : m_entries)
+	{
+		if (entry.Thread == &thread)
+		{
+			entry.BudgetMs = budgetMs;
+			return;
+		}
+	}
+
+	Entry entry;
+	entry.Thread = &thread;
+	entry.BudgetMs = budgetMs;
+	entry.Sequence = thread.GetHeartbeat().GetSequence();
+	entry.SeenNs = NowNs();
+	entry.Reported = false;
+	m_entries.push_back(entry);
+}
+
+//----------------------------------------------------------------------------
+// Remove
+//----------------------------------------------------------------------------
+void Watchdog::Remove(const WorkerThread& thread)
+{
+	lock_guard<mutex> lock(m_mutex);
+	for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		if (it->Thread == &thread)
+		{
+			m_entries.erase(it);
+			return;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Check
+//----------------------------------------------------------------------------
+void Watchdog::Check(INT64 nowNs, std::vector<StallReport>& reports)
+{
+	for (Entry& entry : m_entries)
+	{
+		Heartbeat::Sample sample;
+		if (!entry.Thread->GetHeartbeat().Read(sample))
+			continue;
+
+		// A new message started, or the thread went idle, since the last check
+		if (sample.sequence != entry.Sequence)
+		{
+			entry.Sequence = sample.sequence;
+			entry.SeenNs = nowNs;
+			entry.Reported = false;
+			continue;
+		}
+
+		// Idle or already reported
+		if ((sample.sequence & 1) == 0 || entry.Reported)
+			continue;
+
+		INT64 elapsedMs = (nowNs - entry.SeenNs) / 1000000;
+		if (elapsedMs < entry.BudgetMs)
+			continue;
+
+		entry.Reported = true;
+
+		StallReport report;
+		report.threadName = entry.Thread->GetThreadName();
+		report.msgId = sample.msgId;
+		report.func = sample.func;
+		report.userData = sample.userData;
+		report.machine = sample.machine;
+		report.machineName = sample.machine ? sample.machineName : NULL;
+		report.state = sample.machine ? sample.state : 0;
+		report.elapsedMs = static_cast<UINT32>(elapsedMs);
+		reports.push_back(report);
+	}
+}
+
+//----------------------------------------------------------------------------
+// Process
+//----------------------------------------------------------------------------
+void Watchdog::Process()
+{
+	std::vector<StallReport> reports;
+
+	std::unique_lock<std::mutex> lk(m_mutex);
+	while (!m_exit)
+	{
+		m_cv.wait_for(lk, std::chrono::milliseconds(m_checkIntervalMs));
+		if (m_exit)
+			break;
+
+		Check(NowNs(), reports);
+
+		// Invoke callbacks outside the lock so subscribers may call Add/Remove
+		if (!reports.empty())
+		{
+			lk.unlock();
+			for (const StallReport& report : reports)
+				StallDetected(report);
+			reports.clear();
+			lk.lock();
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#include "AsyncCallback.h"
+#include "WorkerThreadStd.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+/// @brief Describes a WorkerThread message handler that exceeded its budget.
+struct StallReport
+{
+	/// The stalled thread name
+	std::string threadName;
+
+	/// The thread message ID being handled
+	UINT32 msgId;
+
+	/// The callback function being executed or NULL for a non-callback message
+	Heartbeat::Function func;
+
+	/// The callback user data. For a state machine event callback, the machine.
+	void* userData;
+
+	/// The last state machine to change state while handling the message or
+	/// NULL if none did
+	const void* machine;
+
+	/// The state machine type name or NULL
+	const char* machineName;
+
+	/// The state machine current state
+	BYTE state;
+
+	/// Time the handler had been running when the stall was detected
+	UINT32 elapsedMs;
+};
+
+/// @brief Monitors WorkerThread heartbeats from its own thread and reports
+/// any message handler that runs longer than the thread's budget. Each stall
+/// is reported once.
+/// @details Stalls are detected within one check interval past the budget.
+/// The elapsed time is measured from when the watchdog first saw the handler.
+class Watchdog
+{
+public:
+	/// Constructor
+	Watchdog();
+
+	/// Destructor
+	~Watchdog();
+
+	/// Start the monitor thread.
+	/// @param[in] checkIntervalMs - the time between heartbeat checks.
+	void Start(UINT32 checkIntervalMs = 50);
+
+	/// Stop the monitor thread.
+	void Stop();
+
+	/// Monitor a thread. May be called at any time.
+	/// @param[in] thread - the thread to monitor. Must remain valid until removed.
+	/// @param[in] budgetMs - the longest a single message handler may run.
+	void Add(const WorkerThread& thread, UINT32 budgetMs);
+
+	/// Stop monitoring a thread. May be called at any time.
+	/// @param[in] thread - a monitored thread.
+	void Remove(const WorkerThread& thread);
+
+	/// Invoked on the monitor thread for each stall detected. Register a callback
+	/// on a thread other than the monitored threads.
+	AsyncCallback<StallReport> StallDetected;
+
+private:
+	Watchdog(const Watchdog&) = delete;
+	Watchdog& operator=(const Watchdog&) = delete;
+
+	struct Entry
+	{
+		const WorkerThread* Thread;
+		UINT32 BudgetMs;
+		UINT64 Sequence;
+		INT64 SeenNs;
+		bool Reported;
+	};
+
+	/// Entry point for the monitor thread
+	void Process();
+
+	/// Check each monitored heartbeat.
+	/// @param[in] nowNs - the current steady clock time in nanoseconds.
+	/// @param[out] reports - the stalls detected.
+	void Check(INT64 nowNs, std::vector<StallReport>& reports);
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_exit;
+	UINT32 m_checkIntervalMs;
+
+	/// Monitored threads. Guarded by m_mutex.
+	std::vector<Entry> m_entries;
+};
+
+#endif
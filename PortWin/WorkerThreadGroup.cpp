@@ -0,0 +1,170 @@
+#include "WorkerThreadGroup.h"
+#include "AsyncCallbackBase.h"
+
+using namespace std;
+
+// The group the calling thread consumes for, if any
+static thread_local const WorkerThreadGroup* currentGroup = NULL;
+
+//----------------------------------------------------------------------------
+// WorkerThreadGroup
+//----------------------------------------------------------------------------
+WorkerThreadGroup::WorkerThreadGroup(const std::string& groupName, size_t threadCount) :
+	m_queueCount(0),
+	m_exit(false),
+	m_started(false),
+	m_queueSize(0),
+	m_dispatchCount(0),
+	m_rejected(0),
+	m_expired(0),
+	GROUP_NAME(groupName),
+	THREAD_COUNT(threadCount)
+{
+	ASSERT_TRUE(threadCount != 0);
+}
+
+//----------------------------------------------------------------------------
+// ~WorkerThreadGroup
+//----------------------------------------------------------------------------
+WorkerThreadGroup::~WorkerThreadGroup()
+{
+	ExitThread();
+}
+
+//----------------------------------------------------------------------------
+// CreateThread
+//----------------------------------------------------------------------------
+bool WorkerThreadGroup::CreateThread()
+{
+	if (m_threads.empty())
+	{
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_exit = false;
+		}
+
+		for (size_t i = 0; i < THREAD_COUNT; i++)
+			m_threads.push_back(std::thread(&WorkerThreadGroup::Process, this));
+
+		// Accept messages once the consumers exist
+		lock_guard<mutex> lock(m_mutex);
+		m_started = true;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// ExitThread
+//----------------------------------------------------------------------------
+void WorkerThreadGroup::ExitThread()
+{
+	if (m_threads.empty())
+		return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_exit = true;
+		m_started = false;
+	}
+	m_cv.notify_all();
+
+	for (std::thread& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+
+	DiscardQueue();
+}
+
+//----------------------------------------------------------------------------
+// DiscardQueue
+//----------------------------------------------------------------------------
+void WorkerThreadGroup::DiscardQueue()
+{
+	std::deque<CallbackMsg*> remaining[PRIORITY_LANES];
+	{
+		lock_guard<mutex> lock(m_mutex);
+		for (int lane = 0; lane < PRIORITY_LANES; lane++)
+			remaining[lane].swap(m_queue[lane]);
+		m_queueCount = 0;
+		m_queueSize = 0;
+	}
+
+	for (int lane = 0; lane < PRIORITY_LANES; lane++)
+	{
+		for (CallbackMsg* msg : remaining[lane])
+			msg->GetAsyncCallback()->TargetDiscard(&msg);
+	}
+}
+
+//----------------------------------------------------------------------------
+// IsCurrentThread
+//----------------------------------------------------------------------------
+bool WorkerThreadGroup::IsCurrentThread() const
+{
+	return currentGroup == this;
+}
+
+//----------------------------------------------------------------------------
+// DispatchCallback
+//----------------------------------------------------------------------------
+bool WorkerThreadGroup::DispatchCallback(CallbackMsg* msg)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (!m_exit && m_started)
+		{
+			m_queue[msg->GetPriority()].push_back(msg);
+			m_queueCount++;
+			m_queueSize.store(m_queueCount, std::memory_order_relaxed);
+			m_cv.notify_one();
+			return true;
+		}
+	}
+
+	// Messages dispatched after exit are never processed
+	m_rejected++;
+	msg->GetAsyncCallback()->TargetDiscard(&msg);
+	return false;
+}
+
+//----------------------------------------------------------------------------
+// Process
+//----------------------------------------------------------------------------
+void WorkerThreadGroup::Process()
+{
+	currentGroup = this;
+
+	while (1)
+	{
+		CallbackMsg* msg = NULL;
+		{
+			std::unique_lock<std::mutex> lk(m_mutex);
+			while (m_queueCount == 0 && !m_exit)
+				m_cv.wait(lk);
+			if (m_exit)
+				break;
+
+			// Highest priority non-empty lane first
+			int lane = 0;
+			while (m_queue[lane].empty())
+				lane++;
+			msg = m_queue[lane].front();
+			m_queue[lane].pop_front();
+			m_queueCount--;
+			m_queueSize.store(m_queueCount, std::memory_order_relaxed);
+		}
+
+		// Discard a stale message without running the target
+		if (msg->IsExpired())
+		{
+			msg->GetAsyncCallback()->TargetDiscard(&msg);
+			m_expired++;
+			continue;
+		}
+
+		msg->GetAsyncCallback()->TargetInvoke(&msg);
+		m_dispatchCount++;
+	}
+
+	currentGroup = NULL;
+}
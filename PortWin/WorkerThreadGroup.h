@@ -0,0 +1,101 @@
+#ifndef _WORKER_THREAD_GROUP_H
+#define _WORKER_THREAD_GROUP_H
+
+#include "CallbackThread.h"
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+/// @brief A CallbackThread with several consumer threads sharing one queue.
+/// Callbacks dispatched to the group run on whichever thread is free, so
+/// CPU-heavy stateless subscribers scale across cores.
+/// @details Callbacks may run concurrently and out of dispatch order, so the
+/// group is not suitable for state machines, which must stay on a WorkerThread.
+/// The queue drains priority lanes strictly and discards expired messages.
+/// The queue is unbounded and timers are not processed on the group threads.
+/// DISPATCH_DEFERRED callbacks are queued.
+class WorkerThreadGroup : public CallbackThread
+{
+public:
+	/// Constructor
+	/// @param[in] groupName - the group name.
+	/// @param[in] threadCount - the number of consumer threads.
+	WorkerThreadGroup(const std::string& groupName, size_t threadCount);
+
+	/// Destructor
+	~WorkerThreadGroup();
+
+	/// Called once to create the consumer threads
+	/// @return TRUE if the threads are created.
+	bool CreateThread();
+
+	/// Called once at program exit to exit the consumer threads. Queued
+	/// messages are discarded.
+	void ExitThread();
+
+	/// Get the group name
+	const std::string& GetThreadName() const { return GROUP_NAME; }
+
+	/// Get the number of consumer threads
+	size_t GetThreadCount() const { return THREAD_COUNT; }
+
+	/// @see CallbackThread::DispatchCallback
+	virtual bool DispatchCallback(CallbackMsg* msg);
+
+	/// @see CallbackThread::IsCurrentThread
+	/// @return TRUE if called from any thread in the group.
+	virtual bool IsCurrentThread() const;
+
+	/// @see CallbackThread::IsMultiConsumer
+	virtual bool IsMultiConsumer() const { return true; }
+
+	/// Get the number of messages in the queue. May be called from any thread.
+	size_t GetQueueDepth() const { return m_queueSize.load(std::memory_order_relaxed); }
+
+	/// Get the number of callbacks invoked. May be called from any thread.
+	UINT64 GetDispatchCount() const { return m_dispatchCount.load(std::memory_order_relaxed); }
+
+	/// Get the number of messages rejected because the group exited.
+	UINT32 GetRejectedCount() const { return m_rejected; }
+
+	/// Get the number of messages discarded because their deadline passed.
+	UINT32 GetExpiredCount() const { return m_expired; }
+
+private:
+	WorkerThreadGroup(const WorkerThreadGroup&) = delete;
+	WorkerThreadGroup& operator=(const WorkerThreadGroup&) = delete;
+
+	/// Entry point for each consumer thread
+	void Process();
+
+	/// Delete every queued message without invoking the callback.
+	/// @pre The consumer threads have exited.
+	void DiscardQueue();
+
+	/// Consumer threads. Only accessed by CreateThread() and ExitThread().
+	std::vector<std::thread> m_threads;
+
+	/// Message queue per priority lane. Guarded by m_mutex.
+	std::deque<CallbackMsg*> m_queue[PRIORITY_LANES];
+	size_t m_queueCount;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_exit;
+
+	/// TRUE while consumer threads run. Guarded by m_mutex.
+	bool m_started;
+
+	std::atomic<size_t> m_queueSize;
+	std::atomic<UINT64> m_dispatchCount;
+	std::atomic<UINT32> m_rejected;
+	std::atomic<UINT32> m_expired;
+
+	const std::string GROUP_NAME;
+	const size_t THREAD_COUNT;
+};
+
+#endif
@@ -6,17 +6,90 @@
 #include <Windows.h>
 #endif
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 using namespace std;
 
 #define MSG_DISPATCH_DELEGATE	1
 #define MSG_EXIT_THREAD			2
 #define MSG_TIMER				3
 
+//----------------------------------------------------------------------------
+// CpuPause
+//----------------------------------------------------------------------------
+static inline void CpuPause()
+{
+#if defined(WIN32)
+	YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+//----------------------------------------------------------------------------
+// NowNs
+//----------------------------------------------------------------------------
+static inline INT64 NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 //----------------------------------------------------------------------------
 // WorkerThread
 //----------------------------------------------------------------------------
-WorkerThread::WorkerThread(const std::string& threadName) : m_thread(nullptr), m_timerExit(false), THREAD_NAME(threadName)
+WorkerThread::WorkerThread(const std::string& threadName) : 
+	m_thread(nullptr), 
+	m_threadId(std::thread::id()),
+	m_created(false),
+	m_nativeHandle(),
+	m_handleValid(false),
+	m_optionsApplied(true),
+	m_queueCount(0),
+	m_weighted(false),
+	m_capacity(0),
+	m_overflowPolicy(OVERFLOW_BLOCK),
+	m_exit(false),
+	m_droppedOldest(0),
+	m_droppedNewest(0),
+	m_rejected(0),
+	m_expired(0),
+	m_queueSize(0),
+	m_waiting(false),
+	m_parked(false),
+	m_pollInterval(0),
+	m_wakeStampNs(0),
+	m_spinCount(0),
+	m_yieldCount(0),
+	m_queueHighWater(0),
+	m_dispatchCount(0),
+	m_sampledAsyncCallback(NULL),
+	m_sampledCallbacks(false),
+	m_callbackFunc(NULL),
+	m_callbackStartCpuNs(0),
+	m_callbackStartNs(0),
+#ifdef WORKER_THREAD_METRICS
+	m_messagesPerSecond(0),
+#endif
+	m_timerExit(false), 
+	THREAD_NAME(threadName)
 {
+	for (int phase = 0; phase < WAKE_PHASES; phase++)
+	{
+		m_wakeCount[phase] = 0;
+		m_totalLatencyNs[phase] = 0;
+		m_maxLatencyNs[phase] = 0;
+	}
+	for (int lane = 0; lane < PRIORITY_LANES; lane++)
+	{
+		m_weights[lane] = 1;
+		m_credits[lane] = 0;
+	}
 }
 
 //----------------------------------------------------------------------------
@@ -30,35 +103,201 @@ WorkerThread::~WorkerThread()
 //----------------------------------------------------------------------------
 // CreateThread
 //----------------------------------------------------------------------------
-bool WorkerThread::CreateThread()
+bool WorkerThread::CreateThread(const WorkerThreadOptions& options)
 {
-	if (!m_thread)
 	{
-		m_thread = std::unique_ptr<std::thread>(new thread(&WorkerThread::Process, this));
+		lock_guard<mutex> lock(m_optionsLock);
+		m_options = options;
+	}
+	return CreateThread();
+}
 
-#ifdef WIN32
-		// Get the thread's native Windows handle
-		auto handle = m_thread->native_handle();
+//----------------------------------------------------------------------------
+// CreateThread
+//----------------------------------------------------------------------------
+bool WorkerThread::CreateThread()
+{
+	if (!m_created)
+	{
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_exit = false;
+		}
 
-		// Set the thread name so it shows in the Visual Studio Debug Location toolbar
-		std::wstring wstr(THREAD_NAME.begin(), THREAD_NAME.end());
-		HRESULT hr = SetThreadDescription(handle, wstr.c_str());
-		if (FAILED(hr))
+		size_t stackSize = GetOptions().stackSize;
+#if defined(__linux__)
+		if (stackSize != 0)
 		{
-			// Handle error if needed
+			// std::thread can't set a stack size so create the pthread directly
+			pthread_attr_t attr;
+			pthread_attr_init(&attr);
+			int result = pthread_attr_setstacksize(&attr, stackSize);
+			if (result == 0)
+				result = pthread_create(&m_nativeThread, &attr, &WorkerThread::ThreadEntry, this);
+			pthread_attr_destroy(&attr);
+			if (result != 0)
+				return false;
 		}
+		else
 #endif
+		{
+			m_thread = std::unique_ptr<std::thread>(new thread(&WorkerThread::Process, this));
+		}
+
+		// Publish the handle to SetOptions()
+		{
+			lock_guard<mutex> lock(m_optionsLock);
+#if defined(__linux__)
+			m_nativeHandle = m_thread ? m_thread->native_handle() : m_nativeThread;
+#else
+			m_nativeHandle = m_thread->native_handle();
+#endif
+			m_handleValid = true;
+		}
+		m_created = true;
+
+		// Wait for the thread to start so GetThreadId() and IsCurrentThread() 
+		// are valid on return
+		std::unique_lock<std::mutex> lk(m_mutex);
+		while (m_threadId.load() == std::thread::id())
+			m_cvStarted.wait(lk);
+		return m_optionsApplied;
 	}
 	return true;
 }
 
+#if defined(__linux__)
+//----------------------------------------------------------------------------
+// ThreadEntry
+//----------------------------------------------------------------------------
+void* WorkerThread::ThreadEntry(void* arg)
+{
+	static_cast<WorkerThread*>(arg)->Process();
+	return NULL;
+}
+#endif
+
+//----------------------------------------------------------------------------
+// SetOptions
+//----------------------------------------------------------------------------
+bool WorkerThread::SetOptions(const WorkerThreadOptions& options)
+{
+	lock_guard<mutex> lock(m_optionsLock);
+	m_options = options;
+
+	bool applied = true;
+	if (m_handleValid)
+		applied = ApplyOptions(m_nativeHandle, m_options, GetName());
+	if (m_timerThread.joinable())
+		applied = ApplyOptions(m_timerThread.native_handle(), m_options, GetTimerName()) && applied;
+	return applied;
+}
+
+//----------------------------------------------------------------------------
+// GetOptions
+//----------------------------------------------------------------------------
+WorkerThreadOptions WorkerThread::GetOptions()
+{
+	lock_guard<mutex> lock(m_optionsLock);
+	return m_options;
+}
+
+//----------------------------------------------------------------------------
+// GetName
+//----------------------------------------------------------------------------
+std::string WorkerThread::GetName() const
+{
+	return m_options.name.empty() ? THREAD_NAME : m_options.name;
+}
+
+//----------------------------------------------------------------------------
+// GetTimerName
+//----------------------------------------------------------------------------
+std::string WorkerThread::GetTimerName() const
+{
+	// Keep the suffix within the Linux 15 character name limit
+	return GetName().substr(0, 11) + "-tmr";
+}
+
+//----------------------------------------------------------------------------
+// ApplyOptions
+//----------------------------------------------------------------------------
+bool WorkerThread::ApplyOptions(std::thread::native_handle_type handle, 
+	const WorkerThreadOptions& options, const std::string& name)
+{
+	bool applied = true;
+
+#if defined(__linux__)
+	if (!options.cpus.empty())
+	{
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		for (int cpu : options.cpus)
+			CPU_SET(cpu, &cpuSet);
+		if (pthread_setaffinity_np(handle, sizeof(cpuSet), &cpuSet) != 0)
+			applied = false;
+	}
+
+	if (options.schedPolicy != SCHED_POLICY_INHERIT)
+	{
+		int policy = SCHED_OTHER;
+		sched_param param = {};
+		if (options.schedPolicy == SCHED_POLICY_FIFO)
+			policy = SCHED_FIFO;
+		else if (options.schedPolicy == SCHED_POLICY_RR)
+			policy = SCHED_RR;
+		if (policy != SCHED_OTHER)
+			param.sched_priority = options.priority;
+		if (pthread_setschedparam(handle, policy, &param) != 0)
+			applied = false;
+	}
+
+	// Set the thread name so it shows in perf, top and gdb
+	if (pthread_setname_np(handle, name.substr(0, 15).c_str()) != 0)
+		applied = false;
+#elif defined(WIN32)
+	if (!options.cpus.empty())
+	{
+		DWORD_PTR mask = 0;
+		for (int cpu : options.cpus)
+			mask |= static_cast<DWORD_PTR>(1) << cpu;
+		if (SetThreadAffinityMask(handle, mask) == 0)
+			applied = false;
+	}
+
+	if (options.schedPolicy != SCHED_POLICY_INHERIT)
+	{
+		int priority = options.schedPolicy == SCHED_POLICY_OTHER ? 
+			THREAD_PRIORITY_NORMAL : options.priority;
+		if (!SetThreadPriority(handle, priority))
+			applied = false;
+	}
+
+	// Set the thread name so it shows in the Visual Studio Debug Location toolbar
+	std::wstring wstr(name.begin(), name.end());
+	HRESULT hr = SetThreadDescription(handle, wstr.c_str());
+	if (FAILED(hr))
+		applied = false;
+#endif
+
+	return applied;
+}
+
 //----------------------------------------------------------------------------
 // GetThreadId
 //----------------------------------------------------------------------------
 std::thread::id WorkerThread::GetThreadId()
 {
-	ASSERT_TRUE(m_thread != nullptr);
-	return m_thread->get_id();
+	ASSERT_TRUE(m_created);
+	return m_threadId;
+}
+
+//----------------------------------------------------------------------------
+// IsCurrentThread
+//----------------------------------------------------------------------------
+bool WorkerThread::IsCurrentThread() const
+{
+	return m_threadId.load(std::memory_order_relaxed) == this_thread::get_id();
 }
 
 //----------------------------------------------------------------------------
@@ -74,36 +313,556 @@ std::thread::id WorkerThread::GetCurrentThreadId()
 //----------------------------------------------------------------------------
 void WorkerThread::ExitThread()
 {
-	if (!m_thread)
+	if (!m_created)
 		return;
 
 	// Create a new ThreadMsg
 	ThreadMsg* threadMsg = new ThreadMsg(MSG_EXIT_THREAD, 0);
 
-	// Put exit thread message into the queue
+	// Put exit thread message into the lowest lane and release any blocked callers
 	{
 		lock_guard<mutex> lock(m_mutex);
-		m_queue.push(threadMsg);
-		m_cv.notify_one();
+		m_exit = true;
+		PushMsg(threadMsg, PRIORITY_LOW);
+		m_cvNotFull.notify_all();
+	}
+
+	// SetOptions() must not use the handle once the thread is joined
+	{
+		lock_guard<mutex> lock(m_optionsLock);
+		m_handleValid = false;
+	}
+
+	if (m_thread)
+	{
+		m_thread->join();
+		m_thread = nullptr;
 	}
+#if defined(__linux__)
+	else
+	{
+		pthread_join(m_nativeThread, NULL);
+	}
+#endif
+	m_created = false;
+}
+
+//----------------------------------------------------------------------------
+// SetQueueCapacity
+//----------------------------------------------------------------------------
+void WorkerThread::SetQueueCapacity(size_t capacity, OverflowPolicy policy)
+{
+	ASSERT_TRUE(policy != OVERFLOW_DEFAULT);
+
+	lock_guard<mutex> lock(m_mutex);
+	m_capacity = capacity;
+	m_overflowPolicy = policy;
+
+	// Capacity may have grown so let blocked callers recheck
+	m_cvNotFull.notify_all();
+}
 
-    m_thread->join();
-    m_thread = nullptr;
+//----------------------------------------------------------------------------
+// GetQueueCapacity
+//----------------------------------------------------------------------------
+size_t WorkerThread::GetQueueCapacity()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_capacity;
 }
 
 //----------------------------------------------------------------------------
 // DispatchCallback
 //----------------------------------------------------------------------------
-void WorkerThread::DispatchCallback(CallbackMsg* msg)
+bool WorkerThread::DispatchCallback(CallbackMsg* msg)
 {
-	ASSERT_TRUE(m_thread);
+	ASSERT_TRUE(m_created);
 
-	// Create a new ThreadMsg
-	ThreadMsg* threadMsg = new ThreadMsg(MSG_DISPATCH_DELEGATE, msg);
+	// Defer a callback dispatched onto itself without using the shared queue
+	if (IsCurrentThread() && 
+		msg->GetAsyncCallback()->GetDispatchPolicy(*msg->GetCallback()) == DISPATCH_DEFERRED)
+	{
+		m_deferred.push_back(msg);
+		return true;
+	}
+
+	ThreadMsg* droppedMsg = nullptr;
+	bool accepted = true;
+	{
+		std::unique_lock<std::mutex> lk(m_mutex);
+
+		// Is the bounded queue full?
+		if (m_capacity != 0 && m_queueCount >= m_capacity && !m_exit)
+		{
+			OverflowPolicy policy = msg->GetAsyncCallback()->GetOverflowPolicy();
+			if (policy == OVERFLOW_DEFAULT)
+				policy = m_overflowPolicy;
+
+			switch (policy)
+			{
+				case OVERFLOW_BLOCK:
+					// The worker thread can't wait on its own queue to drain, so a 
+					// callback dispatched onto itself exceeds the capacity instead
+					if (!IsCurrentThread())
+					{
+						while (m_capacity != 0 && m_queueCount >= m_capacity && !m_exit)
+							m_cvNotFull.wait(lk);
+					}
+					break;
+
+				case OVERFLOW_FAIL:
+					m_rejected++;
+					accepted = false;
+					break;
+
+				case OVERFLOW_DROP_OLDEST:
+					droppedMsg = PopOldestCallback();
+					if (droppedMsg)
+						m_droppedOldest++;
+					break;
+
+				case OVERFLOW_DROP_NEWEST:
+					m_droppedNewest++;
+					accepted = false;
+					break;
+
+				default:
+					ASSERT();
+			}
+		}
+
+		// Messages dispatched after exit are never processed
+		if (accepted && m_exit)
+		{
+			m_rejected++;
+			accepted = false;
+		}
+
+		if (accepted)
+		{
+			// Add dispatch delegate msg to queue and notify worker thread
+			PushMsg(new ThreadMsg(MSG_DISPATCH_DELEGATE, msg), msg->GetPriority());
+		}
+	}
+
+	// Delete discarded messages outside of the lock
+	if (droppedMsg)
+		DiscardMsg(droppedMsg);
+	if (!accepted)
+		msg->GetAsyncCallback()->TargetDiscard(&msg);
+
+	return accepted;
+}
+
+//----------------------------------------------------------------------------
+// PopOldestCallback
+//----------------------------------------------------------------------------
+ThreadMsg* WorkerThread::PopOldestCallback()
+{
+	// Drop from the lowest priority lane first. Timer and exit messages are 
+	// never dropped.
+	for (int lane = PRIORITY_LANES - 1; lane >= 0; lane--)
+	{
+		std::deque<ThreadMsg*>& queue = m_queue[lane];
+		for (auto it = queue.begin(); it != queue.end(); ++it)
+		{
+			if ((*it)->GetId() == MSG_DISPATCH_DELEGATE)
+			{
+				ThreadMsg* msg = *it;
+				queue.erase(it);
+				m_queueCount--;
+				m_queueSize.store(m_queueCount, std::memory_order_relaxed);
+				return msg;
+			}
+		}
+	}
+	return nullptr;
+}
+
+//----------------------------------------------------------------------------
+// IsUnregistered
+//----------------------------------------------------------------------------
+bool WorkerThread::IsUnregistered(const CallbackMsg* callbackMsg)
+{
+	return !callbackMsg->GetAsyncCallback()->IsRegistered(*callbackMsg->GetCallback());
+}
 
-	// Add dispatch delegate msg to queue and notify worker thread
-	std::unique_lock<std::mutex> lk(m_mutex);
-	m_queue.push(threadMsg);
+//----------------------------------------------------------------------------
+// PurgeUnregistered
+//----------------------------------------------------------------------------
+size_t WorkerThread::PurgeUnregistered()
+{
+	std::vector<ThreadMsg*> purged;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		for (int lane = 0; lane < PRIORITY_LANES; lane++)
+		{
+			// Keep the remaining messages in order
+			std::deque<ThreadMsg*>& queue = m_queue[lane];
+			size_t kept = 0;
+			for (size_t i = 0; i < queue.size(); i++)
+			{
+				ThreadMsg* msg = queue[i];
+				if (msg->GetId() == MSG_DISPATCH_DELEGATE && 
+					IsUnregistered(static_cast<CallbackMsg*>(msg->GetData())))
+					purged.push_back(msg);
+				else
+					queue[kept++] = msg;
+			}
+			queue.resize(kept);
+		}
+
+		if (!purged.empty())
+		{
+			m_queueCount -= purged.size();
+			m_queueSize.store(m_queueCount, std::memory_order_relaxed);
+			m_cvNotFull.notify_all();
+		}
+	}
+
+	// Delete discarded messages outside of the lock
+	for (size_t i = 0; i < purged.size(); i++)
+		DiscardMsg(purged[i]);
+	size_t count = purged.size();
+
+	// Only the worker thread accesses the deferred callbacks
+	if (IsCurrentThread())
+	{
+		std::deque<CallbackMsg*> deferred;
+		deferred.swap(m_deferred);
+		for (size_t i = 0; i < deferred.size(); i++)
+		{
+			CallbackMsg* callbackMsg = deferred[i];
+			if (IsUnregistered(callbackMsg))
+			{
+				callbackMsg->GetAsyncCallback()->TargetDiscard(&callbackMsg);
+				count++;
+			}
+			else
+				m_deferred.push_back(callbackMsg);
+		}
+	}
+	return count;
+}
+
+//----------------------------------------------------------------------------
+// InvokeDeferred
+//----------------------------------------------------------------------------
+void WorkerThread::InvokeDeferred()
+{
+	// Deferred callbacks may defer further callbacks, which run in turn
+	while (!m_deferred.empty())
+	{
+		CallbackMsg* callbackMsg = m_deferred.front();
+		m_deferred.pop_front();
+		InvokeCallback(callbackMsg);
+	}
+}
+
+//----------------------------------------------------------------------------
+// InvokeCallback
+//----------------------------------------------------------------------------
+bool WorkerThread::InvokeCallback(CallbackMsg* callbackMsg)
+{
+	// Discard a stale message without running the target
+	if (callbackMsg->IsExpired())
+	{
+		callbackMsg->GetAsyncCallback()->TargetDiscard(&callbackMsg);
+		m_expired++;
+		return false;
+	}
+
+	// Identify the client function, not an adapter calling it
+	const Callback* callback = callbackMsg->GetCallback();
+	const CallbackTarget* asyncCallback = callbackMsg->GetAsyncCallback();
+	Callback::CallbackFunc func = asyncCallback->GetTargetFunction(*callback);
+	m_heartbeat.Begin(MSG_DISPATCH_DELEGATE, reinterpret_cast<Heartbeat::Function>(func), callback->GetUserData());
+
+	if (m_cpuAccounting.ShouldSample())
+	{
+		// The message is deleted by TargetInvoke() so keep the identities
+		UINT64 startCpuNs = CpuAccounting::GetThreadCpuNs();
+		INT64 startNs = NowNs();
+
+		m_sampledAsyncCallback = asyncCallback;
+		m_sampledCallbacks = false;
+		asyncCallback->TargetInvoke(&callbackMsg);
+		m_sampledAsyncCallback = NULL;
+
+		// A grouped message records each of its callbacks instead
+		if (!m_sampledCallbacks)
+		{
+			m_cpuAccounting.Record(func, asyncCallback, CpuAccounting::GetThreadCpuNs() - startCpuNs,
+				static_cast<UINT64>(NowNs() - startNs));
+		}
+	}
+	else
+	{
+		asyncCallback->TargetInvoke(&callbackMsg);
+	}
+	m_heartbeat.End();
+	m_dispatchCount.store(m_dispatchCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// BeginCallback
+//----------------------------------------------------------------------------
+void WorkerThread::BeginCallback(Callback::CallbackFunc func, void* userData)
+{
+	// A new heartbeat per callback, so the watchdog budget applies to each
+	// callback and a stall report names the one running
+	m_heartbeat.End();
+	m_heartbeat.Begin(MSG_DISPATCH_DELEGATE, reinterpret_cast<Heartbeat::Function>(func), userData);
+
+	if (m_sampledAsyncCallback != NULL)
+	{
+		m_callbackFunc = func;
+		m_callbackStartCpuNs = CpuAccounting::GetThreadCpuNs();
+		m_callbackStartNs = NowNs();
+	}
+}
+
+//----------------------------------------------------------------------------
+// EndCallback
+//----------------------------------------------------------------------------
+void WorkerThread::EndCallback()
+{
+	if (m_sampledAsyncCallback != NULL)
+	{
+		m_cpuAccounting.Record(m_callbackFunc, m_sampledAsyncCallback, 
+			CpuAccounting::GetThreadCpuNs() - m_callbackStartCpuNs, static_cast<UINT64>(NowNs() - m_callbackStartNs));
+		m_sampledCallbacks = true;
+	}
+}
+
+//----------------------------------------------------------------------------
+// PushMsg
+//----------------------------------------------------------------------------
+void WorkerThread::PushMsg(ThreadMsg* msg, CallbackPriority lane)
+{
+	ASSERT_TRUE(lane < PRIORITY_LANES);
+
+	// Stamp the first message to arrive on an idle thread for wake latency
+	if (m_waiting && m_queueCount == 0)
+		m_wakeStampNs = NowNs();
+
+#ifdef WORKER_THREAD_METRICS
+	msg->SetEnqueueTime(NowNs());
+#endif
+
+	m_queue[lane].push_back(msg);
+	m_queueCount++;
+	m_queueSize.store(m_queueCount, std::memory_order_release);
+	if (m_queueCount > m_queueHighWater.load(std::memory_order_relaxed))
+		m_queueHighWater.store(m_queueCount, std::memory_order_relaxed);
+
+	// A spinning or yielding thread sees m_queueSize change without a notify
+	if (m_parked)
+		Unpark();
+}
+
+//----------------------------------------------------------------------------
+// PopNextMsg
+//----------------------------------------------------------------------------
+ThreadMsg* WorkerThread::PopNextMsg()
+{
+	ASSERT_TRUE(m_queueCount != 0);
+
+	int lane = 0;
+	if (!m_weighted)
+	{
+		// Strict priority. Highest priority non-empty lane first. 
+		while (m_queue[lane].empty())
+			lane++;
+	}
+	else
+	{
+		// Weighted round robin. Highest priority lane with credit remaining, 
+		// starting a new round once every non-empty lane has used its credit.
+		while (lane < PRIORITY_LANES && (m_queue[lane].empty() || m_credits[lane] == 0))
+			lane++;
+		if (lane == PRIORITY_LANES)
+		{
+			for (int refill = 0; refill < PRIORITY_LANES; refill++)
+				m_credits[refill] = m_weights[refill];
+			lane = 0;
+			while (m_queue[lane].empty())
+				lane++;
+		}
+		m_credits[lane]--;
+	}
+
+	ThreadMsg* msg = m_queue[lane].front();
+	m_queue[lane].pop_front();
+	m_queueCount--;
+	m_queueSize.store(m_queueCount, std::memory_order_relaxed);
+	return msg;
+}
+
+//----------------------------------------------------------------------------
+// SetStrictScheduling
+//----------------------------------------------------------------------------
+void WorkerThread::SetStrictScheduling()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_weighted = false;
+}
+
+//----------------------------------------------------------------------------
+// SetWeightedScheduling
+//----------------------------------------------------------------------------
+void WorkerThread::SetWeightedScheduling(const UINT32 weights[PRIORITY_LANES])
+{
+	ASSERT_TRUE(weights != NULL);
+
+	lock_guard<mutex> lock(m_mutex);
+	m_weighted = true;
+	for (int lane = 0; lane < PRIORITY_LANES; lane++)
+	{
+		m_weights[lane] = weights[lane] != 0 ? weights[lane] : 1;
+		m_credits[lane] = m_weights[lane];
+	}
+}
+
+//----------------------------------------------------------------------------
+// DiscardMsg
+//----------------------------------------------------------------------------
+void WorkerThread::DiscardMsg(ThreadMsg* msg)
+{
+	if (msg->GetId() == MSG_DISPATCH_DELEGATE)
+	{
+		CallbackMsg* callbackMsg = static_cast<CallbackMsg*>(msg->GetData());
+		callbackMsg->GetAsyncCallback()->TargetDiscard(&callbackMsg);
+	}
+	delete msg;
+}
+
+//----------------------------------------------------------------------------
+// SetWaitStrategy
+//----------------------------------------------------------------------------
+void WorkerThread::SetWaitStrategy(const WaitStrategy& strategy)
+{
+	m_spinCount = strategy.spinCount;
+	m_yieldCount = strategy.yieldCount;
+}
+
+//----------------------------------------------------------------------------
+// GetWaitStrategy
+//----------------------------------------------------------------------------
+WorkerThread::WaitStrategy WorkerThread::GetWaitStrategy() const
+{
+	WaitStrategy strategy;
+	strategy.spinCount = m_spinCount;
+	strategy.yieldCount = m_yieldCount;
+	return strategy;
+}
+
+//----------------------------------------------------------------------------
+// GetWaitStats
+//----------------------------------------------------------------------------
+WorkerThread::WaitStats WorkerThread::GetWaitStats() const
+{
+	WaitStats stats;
+	for (int phase = 0; phase < WAKE_PHASES; phase++)
+	{
+		stats.wakeCount[phase] = m_wakeCount[phase].load(std::memory_order_relaxed);
+		stats.totalLatencyNs[phase] = m_totalLatencyNs[phase].load(std::memory_order_relaxed);
+		stats.maxLatencyNs[phase] = m_maxLatencyNs[phase].load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+//----------------------------------------------------------------------------
+// WaitForMessage
+//----------------------------------------------------------------------------
+void WorkerThread::WaitForMessage(std::unique_lock<std::mutex>& lk)
+{
+	const UINT32 spinCount = m_spinCount.load(std::memory_order_relaxed);
+	const UINT32 yieldCount = m_yieldCount.load(std::memory_order_relaxed);
+
+	m_waiting = true;
+	WakePhase phase = WAKE_PARK;
+
+	if (spinCount != 0 || yieldCount != 0)
+	{
+		lk.unlock();
+
+		// Poll the queue depth using a CPU pause instruction
+		for (UINT32 spin = 0; spin < spinCount && phase == WAKE_PARK; spin++)
+		{
+			if (m_queueSize.load(std::memory_order_acquire) != 0)
+				phase = WAKE_SPIN;
+			else
+				CpuPause();
+		}
+
+		// Poll the queue depth giving up the processor between checks
+		for (UINT32 yield = 0; yield < yieldCount && phase == WAKE_PARK; yield++)
+		{
+			if (m_queueSize.load(std::memory_order_acquire) != 0)
+				phase = WAKE_YIELD;
+			else
+				std::this_thread::yield();
+		}
+
+		lk.lock();
+	}
+
+	// Nothing arrived while polling so block until a producer notifies. An 
+	// event handler run by Park() may also defer callbacks onto this thread. 
+	if (m_queueCount == 0 && m_deferred.empty())
+	{
+		phase = WAKE_PARK;
+		m_parked = true;
+		while (m_queueCount == 0 && m_deferred.empty())
+			Park(lk);
+		m_parked = false;
+	}
+	m_waiting = false;
+
+	// Update wake statistics. Only this thread writes the counters. 
+	UINT64 latencyNs = static_cast<UINT64>(NowNs() - m_wakeStampNs);
+	m_wakeCount[phase].store(m_wakeCount[phase].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_totalLatencyNs[phase].store(m_totalLatencyNs[phase].load(std::memory_order_relaxed) + latencyNs, std::memory_order_relaxed);
+	if (latencyNs > m_maxLatencyNs[phase].load(std::memory_order_relaxed))
+		m_maxLatencyNs[phase].store(latencyNs, std::memory_order_relaxed);
+}
+
+#ifdef WORKER_THREAD_METRICS
+//----------------------------------------------------------------------------
+// UpdateRate
+//----------------------------------------------------------------------------
+void WorkerThread::UpdateRate(INT64 nowNs)
+{
+	static const INT64 RATE_INTERVAL_NS = 1000000000;
+
+	// Timer messages arrive periodically so an idle thread's rate decays to 0
+	INT64 elapsedNs = nowNs - m_rateStartNs;
+	if (elapsedNs >= RATE_INTERVAL_NS)
+	{
+		UINT64 dispatchCount = m_dispatchCount.load(std::memory_order_relaxed);
+		UINT64 rate = (dispatchCount - m_rateDispatchCount) * RATE_INTERVAL_NS / elapsedNs;
+		m_messagesPerSecond.store(static_cast<UINT32>(rate), std::memory_order_relaxed);
+		m_rateDispatchCount = dispatchCount;
+		m_rateStartNs = nowNs;
+	}
+}
+#endif
+
+//----------------------------------------------------------------------------
+// Park
+//----------------------------------------------------------------------------
+void WorkerThread::Park(std::unique_lock<std::mutex>& lk)
+{
+	m_cv.wait(lk);
+}
+
+//----------------------------------------------------------------------------
+// Unpark
+//----------------------------------------------------------------------------
+void WorkerThread::Unpark()
+{
 	m_cv.notify_one();
 }
 
@@ -120,8 +879,7 @@ void WorkerThread::TimerThread()
 
         // Add timer msg to queue and notify worker thread
         std::unique_lock<std::mutex> lk(m_mutex);
-        m_queue.push(threadMsg);
-        m_cv.notify_one();
+        PushMsg(threadMsg, PRIORITY_NORMAL);
     }
 }
 
@@ -130,25 +888,82 @@ void WorkerThread::TimerThread()
 //----------------------------------------------------------------------------
 void WorkerThread::Process()
 {
-    m_timerExit = false;
-    std::thread timerThread(&WorkerThread::TimerThread, this);
+	bool applied;
+	{
+		lock_guard<mutex> lock(m_optionsLock);
+
+		// Apply the options to this thread and the timer thread
+#if defined(__linux__)
+		applied = ApplyOptions(pthread_self(), m_options, GetName());
+#elif defined(WIN32)
+		applied = ApplyOptions(GetCurrentThread(), m_options, GetName());
+#else
+		applied = true;
+#endif
+		m_timerExit = false;
+		m_timerThread = std::thread(&WorkerThread::TimerThread, this);
+		applied = ApplyOptions(m_timerThread.native_handle(), m_options, GetTimerName()) && applied;
+	}
+
+	// State machines running on this thread publish to its heartbeat
+	Heartbeat::SetCurrent(&m_heartbeat);
+
+	// Signal CreateThread() that the thread is running
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_optionsApplied = applied;
+		m_threadId = this_thread::get_id();
+	}
+	m_cvStarted.notify_all();
+
+	UINT32 pollCount = 0;
 
 	while (1)
 	{
+		// Run callbacks deferred by the previous message ahead of the queue
+		InvokeDeferred();
+
+		// Give other event sources a turn while the queue stays busy
+		UINT32 pollInterval = m_pollInterval.load(std::memory_order_relaxed);
+		if (pollInterval != 0 && ++pollCount >= pollInterval)
+		{
+			pollCount = 0;
+			Poll();
+		}
+
 		ThreadMsg* msg = nullptr;
 		{
 			// Wait for a message to be added to the queue
 			std::unique_lock<std::mutex> lk(m_mutex);
-			while (m_queue.empty())
-				m_cv.wait(lk);
+			if (m_queueCount == 0)
+			{
+				WaitForMessage(lk);
 
-			if (m_queue.empty())
+				// Woken to run deferred callbacks rather than a message
+				if (m_queueCount == 0)
+					continue;
+			}
+
+			msg = PopNextMsg();
+
+			// Exit once the messages queued ahead of the exit request in
+			// higher priority lanes have been processed
+			if (msg->GetId() == MSG_EXIT_THREAD && m_queueCount != 0)
+			{
+				PushMsg(msg, PRIORITY_LOW);
 				continue;
+			}
 
-			msg = m_queue.front();
-			m_queue.pop();
+			// Space available for a caller blocked on a full queue
+			if (m_capacity != 0)
+				m_cvNotFull.notify_one();
 		}
 
+#ifdef WORKER_THREAD_METRICS
+		INT64 dispatchNs = NowNs();
+		UpdateRate(dispatchNs);
+#endif
+
 		switch (msg->GetId())
 		{
 			case MSG_DISPATCH_DELEGATE:
@@ -159,7 +974,15 @@ void WorkerThread::Process()
 				CallbackMsg* callbackMsg = static_cast<CallbackMsg*>(msg->GetData());
 
 				// Invoke the callback callback on the target thread
-				callbackMsg->GetAsyncCallback()->TargetInvoke(&callbackMsg);
+#ifdef WORKER_THREAD_METRICS
+				if (InvokeCallback(callbackMsg))
+				{
+					m_queueLatency.Record(static_cast<UINT64>(dispatchNs - msg->GetEnqueueTime()));
+					m_executionTime.Record(static_cast<UINT64>(NowNs() - dispatchNs));
+				}
+#else
+				InvokeCallback(callbackMsg);
+#endif
 
 				// Delete dynamic data passed through message queue
 				delete msg;
@@ -167,13 +990,40 @@ void WorkerThread::Process()
 			}
 
             case MSG_TIMER:
+				m_heartbeat.Begin(MSG_TIMER, NULL, NULL);
                 Timer::ProcessTimers();
+				m_heartbeat.End();
+                delete msg;
                 break;
 
 			case MSG_EXIT_THREAD:
 			{
+                delete msg;
                 m_timerExit = true;
+
+				std::thread timerThread;
+				{
+					lock_guard<mutex> lock(m_optionsLock);
+					timerThread.swap(m_timerThread);
+				}
                 timerThread.join();
+
+				// Delete any messages left unprocessed in the queue
+				std::deque<ThreadMsg*> remaining[PRIORITY_LANES];
+				{
+					std::unique_lock<std::mutex> lk(m_mutex);
+					for (int lane = 0; lane < PRIORITY_LANES; lane++)
+						remaining[lane].swap(m_queue[lane]);
+					m_queueCount = 0;
+					m_queueSize = 0;
+				}
+				for (int lane = 0; lane < PRIORITY_LANES; lane++)
+				{
+					for (ThreadMsg* remainingMsg : remaining[lane])
+						DiscardMsg(remainingMsg);
+				}
+				m_threadId = std::thread::id();
+				Heartbeat::SetCurrent(NULL);
                 return;
 			}
 
@@ -5,18 +5,92 @@
 // David Lafreniere, Feb 2017.
 
 #include "CallbackThread.h"
+#include "Heartbeat.h"
+#include "CpuAccounting.h"
+#ifdef WORKER_THREAD_METRICS
+#include "LatencyHistogram.h"
+#endif
 #include <thread>
-#include <queue>
+#include <deque>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
 #include <string>
+#include <vector>
 
 class ThreadMsg;
 
+/// @brief WorkerThread scheduling policy
+enum SchedPolicy
+{
+	/// Leave the scheduling policy and priority unchanged
+	SCHED_POLICY_INHERIT,
+
+	/// Normal time-shared scheduling
+	SCHED_POLICY_OTHER,
+
+	/// Real-time first-in first-out scheduling
+	SCHED_POLICY_FIFO,
+
+	/// Real-time round-robin scheduling
+	SCHED_POLICY_RR
+};
+
+/// @brief Options applied to a WorkerThread and its internal timer thread. 
+struct WorkerThreadOptions
+{
+	WorkerThreadOptions() : schedPolicy(SCHED_POLICY_INHERIT), priority(0), stackSize(0) {}
+
+	/// CPUs the threads may run on. Empty leaves the affinity unchanged. 
+	std::vector<int> cpus;
+
+	/// Scheduling policy. 
+	SchedPolicy schedPolicy;
+
+	/// Scheduling priority. On Linux, 1 to 99 for SCHED_POLICY_FIFO and 
+	/// SCHED_POLICY_RR. On Windows, a THREAD_PRIORITY_* value. 
+	int priority;
+
+	/// Worker thread stack size in bytes. 0 uses the platform default. Only 
+	/// applied on Linux when the thread is created. 
+	size_t stackSize;
+
+	/// Thread name shown by debuggers, perf and top. Empty uses the WorkerThread
+	/// name. Linux truncates names to 15 characters. 
+	std::string name;
+};
+
 class WorkerThread : public CallbackThread
 {
 public:
+	/// @brief Controls how the thread waits when its queue is empty. The thread 
+	/// first polls the queue spinCount times using a CPU pause instruction, then
+	/// yieldCount times yielding the processor, and finally parks on a condition
+	/// variable. Spinning trades CPU time for lower wake latency. 
+	struct WaitStrategy
+	{
+		UINT32 spinCount;
+		UINT32 yieldCount;
+	};
+
+	/// The wait phase a message arrived in
+	enum WakePhase
+	{
+		WAKE_SPIN,
+		WAKE_YIELD,
+		WAKE_PARK,
+		WAKE_PHASES
+	};
+
+	/// @brief Wake statistics indexed by WakePhase. Latency is measured from
+	/// the time a message is queued on an idle thread until the thread resumes.
+	struct WaitStats
+	{
+		UINT64 wakeCount[WAKE_PHASES];
+		UINT64 totalLatencyNs[WAKE_PHASES];
+		UINT64 maxLatencyNs[WAKE_PHASES];
+	};
+
 	/// Constructor
 	WorkerThread(const std::string& threadName);
 
@@ -27,6 +101,23 @@ public:
 	/// @return TRUE if thread is created. FALSE otherise. 
 	bool CreateThread();
 
+	/// Called once to create the worker thread using the specified options.
+	/// @param[in] options - the thread options. 
+	/// @return TRUE if thread is created and all options applied. FALSE if an 
+	///		option could not be applied, such as a real-time policy without 
+	///		permission. The thread is still created. 
+	bool CreateThread(const WorkerThreadOptions& options);
+
+	/// Apply options to the running worker and timer threads and save them for 
+	/// the next CreateThread(). May be called at any time from any thread. 
+	/// @param[in] options - the thread options. The stack size takes effect 
+	///		on the next CreateThread(). 
+	/// @return TRUE if all options applied. FALSE otherwise. 
+	bool SetOptions(const WorkerThreadOptions& options);
+
+	/// Get the thread options.
+	WorkerThreadOptions GetOptions();
+
 	/// Called once a program exit to exit the worker thread
 	void ExitThread();
 
@@ -36,8 +127,133 @@ public:
 	/// Get the ID of the currently executing thread
 	static std::thread::id GetCurrentThreadId();
 
-	/// Dispatch callback message onto the thread
-	virtual void DispatchCallback(CallbackMsg* msg);
+	/// Get the thread name
+	const std::string& GetThreadName() const { return THREAD_NAME; }
+
+	/// Dispatch callback message onto the thread. A DISPATCH_DEFERRED callback
+	/// dispatched by this thread onto itself bypasses the queue and executes
+	/// once the current message completes.
+	virtual bool DispatchCallback(CallbackMsg* msg);
+
+	/// @see CallbackThread::IsCurrentThread
+	virtual bool IsCurrentThread() const;
+
+	/// Publish each callback of a grouped or batch message to the heartbeat
+	/// and, when sampled, time it for CPU accounting. 
+	/// @see CallbackThread::BeginCallback
+	virtual void BeginCallback(Callback::CallbackFunc func, void* userData);
+
+	/// @see CallbackThread::EndCallback
+	virtual void EndCallback();
+
+	/// Bound the number of messages held in the thread queue. May be called 
+	/// at any time. 
+	/// @param[in] capacity - the maximum queue depth. 0 for an unbounded queue.
+	/// @param[in] policy - the action taken when a message is dispatched onto
+	///		a full queue. An AsyncCallback may override the policy using 
+	///		AsyncCallbackBase::SetOverflowPolicy(). 
+	/// @pre OVERFLOW_DEFAULT is not a valid thread policy. 
+	void SetQueueCapacity(size_t capacity, OverflowPolicy policy = OVERFLOW_BLOCK);
+
+	/// Get the maximum queue depth. 
+	/// @return The queue capacity or 0 if unbounded. 
+	size_t GetQueueCapacity();
+
+	/// Get the number of queued messages discarded by OVERFLOW_DROP_OLDEST.
+	UINT32 GetDroppedOldestCount() const { return m_droppedOldest; }
+
+	/// Get the number of new messages discarded by OVERFLOW_DROP_NEWEST.
+	UINT32 GetDroppedNewestCount() const { return m_droppedNewest; }
+
+	/// Get the number of messages rejected by OVERFLOW_FAIL, or by 
+	/// OVERFLOW_BLOCK when the thread exits while the caller is blocked.
+	UINT32 GetRejectedCount() const { return m_rejected; }
+
+	/// Get the number of callback messages discarded because their deadline
+	/// passed before the thread dispatched them. 
+	/// @see AsyncCallbackBase::SetTimeToLive
+	UINT32 GetExpiredCount() const { return m_expired; }
+
+	/// Discard queued callback messages whose client unregistered after the 
+	/// message was dispatched, so a state machine leaving a busy state doesn't
+	/// process a stale backlog. Called on the worker thread, deferred callbacks
+	/// are purged as well. A message grouping several clients stays queued and
+	/// skips the unregistered clients when invoked. May be called from any thread.
+	/// @return The number of messages discarded. 
+	size_t PurgeUnregistered();
+
+	/// Set the idle wait strategy. May be called at any time. The default 
+	/// strategy parks immediately. 
+	/// @param[in] strategy - the spin and yield thresholds.
+	void SetWaitStrategy(const WaitStrategy& strategy);
+
+	/// Get the idle wait strategy. 
+	WaitStrategy GetWaitStrategy() const;
+
+	/// Get the wake statistics. May be called from any thread. 
+	WaitStats GetWaitStats() const;
+
+	/// Drain the priority lanes strictly. A lower priority message is only 
+	/// dispatched when all higher priority lanes are empty. This is the default.
+	/// May be called at any time. 
+	void SetStrictScheduling();
+
+	/// Drain the priority lanes using weighted round robin. Each lane may 
+	/// dispatch up to its weight in messages per round, highest priority first,
+	/// so a busy high priority lane can't starve the lower lanes. 
+	/// May be called at any time. 
+	/// @param[in] weights - the messages per round indexed by CallbackPriority. 
+	///		A weight of 0 is treated as 1. 
+	void SetWeightedScheduling(const UINT32 weights[PRIORITY_LANES]);
+
+	/// Get the number of messages in the queue. May be called from any thread. 
+	size_t GetQueueDepth() const { return m_queueSize.load(std::memory_order_relaxed); }
+
+	/// Get the deepest the queue has been. May be called from any thread. 
+	size_t GetQueueHighWater() const { return m_queueHighWater.load(std::memory_order_relaxed); }
+
+	/// Get the number of callbacks invoked. May be called from any thread. 
+	UINT64 GetDispatchCount() const { return m_dispatchCount.load(std::memory_order_relaxed); }
+
+	/// Get the heartbeat describing the message being handled. May be called
+	/// from any thread. 
+	/// @see Watchdog
+	const Heartbeat& GetHeartbeat() const { return m_heartbeat; }
+
+	/// Get the per-callback CPU time accounting. Disabled until a sample 
+	/// interval is set. May be called from any thread. 
+	CpuAccounting& GetCpuAccounting() { return m_cpuAccounting; }
+
+#ifdef WORKER_THREAD_METRICS
+	/// Get the callbacks invoked over the most recent one second interval. 
+	/// May be called from any thread. 
+	UINT32 GetMessagesPerSecond() const { return m_messagesPerSecond.load(std::memory_order_relaxed); }
+
+	/// Get the time callback messages wait in the queue before dispatch. 
+	/// May be called from any thread. 
+	const LatencyHistogram& GetQueueLatency() const { return m_queueLatency; }
+
+	/// Get the time spent executing callbacks. May be called from any thread. 
+	const LatencyHistogram& GetExecutionTime() const { return m_executionTime; }
+#endif
+
+protected:
+	/// Block the worker thread until Unpark() is called. Derived classes may
+	/// override to wait on other event sources. Spurious returns are allowed.
+	/// @param[in] lk - the locked queue mutex. The lock must be held on return.
+	virtual void Park(std::unique_lock<std::mutex>& lk);
+
+	/// Wake the worker thread blocked in Park(). 
+	/// @pre The caller holds the queue mutex.
+	virtual void Unpark();
+
+	/// Called by the worker thread between messages once every poll interval
+	/// so a busy message queue does not starve other event sources. 
+	virtual void Poll() {}
+
+	/// Set the number of messages processed between Poll() calls. 
+	/// @param[in] interval - the message count. 0 disables Poll() calls. 
+	void SetPollInterval(UINT32 interval) { m_pollInterval = interval; }
 
 private:
 	WorkerThread(const WorkerThread&) = delete;
@@ -49,10 +265,149 @@ private:
     /// Entry point for timer thread
     void TimerThread();
 
+#if defined(__linux__)
+	/// Entry point for a worker thread created with a custom stack size
+	static void* ThreadEntry(void* arg);
+#endif
+
+	/// Apply options to a thread. 
+	/// @param[in] handle - the native thread handle. 
+	/// @param[in] options - the options to apply. 
+	/// @param[in] name - the thread name.
+	/// @return TRUE if all options applied. 
+	static bool ApplyOptions(std::thread::native_handle_type handle, 
+		const WorkerThreadOptions& options, const std::string& name);
+
+	/// Get the names used for the worker and timer threads.
+	/// @pre The caller holds m_optionsLock.
+	std::string GetName() const;
+	std::string GetTimerName() const;
+
+	/// Remove the oldest callback message from the queue. 
+	/// @pre The caller holds m_mutex.
+	/// @return The removed message or nullptr if none are queued. 
+	ThreadMsg* PopOldestCallback();
+
+	/// Check if a callback message's client has unregistered. 
+	static bool IsUnregistered(const CallbackMsg* callbackMsg);
+
+	/// Delete a thread message without invoking the callback. 
+	static void DiscardMsg(ThreadMsg* msg);
+
+	/// Invoke the deferred callbacks in the order dispatched. 
+	void InvokeDeferred();
+
+	/// Invoke a callback message or discard it if expired. 
+	/// @param[in] callbackMsg - the message to invoke. Deleted before return. 
+	/// @return TRUE if invoked. FALSE if expired. 
+	bool InvokeCallback(CallbackMsg* callbackMsg);
+
+	/// Add a message to a priority lane and wake the thread if parked. 
+	/// @param[in] msg - the message to queue. 
+	/// @param[in] lane - the priority lane. 
+	/// @pre The caller holds m_mutex.
+	void PushMsg(ThreadMsg* msg, CallbackPriority lane);
+
+	/// Remove the next message to process using the scheduling policy. 
+	/// @pre The caller holds m_mutex and the queue is not empty.
+	/// @return The next message. 
+	ThreadMsg* PopNextMsg();
+
+	/// Wait using the wait strategy until the queue is not empty or an event 
+	/// handler run while parked deferred a callback. 
+	/// @param[in] lk - the locked m_mutex. The lock is held on return.
+	void WaitForMessage(std::unique_lock<std::mutex>& lk);
+
 	std::unique_ptr<std::thread> m_thread;
-	std::queue<ThreadMsg*> m_queue;
+	std::atomic<std::thread::id> m_threadId;
+	std::atomic<bool> m_created;
+
+	/// Worker thread handle. Valid from creation until the thread is joined.
+	/// Guarded by m_optionsLock.
+	std::thread::native_handle_type m_nativeHandle;
+	bool m_handleValid;
+#if defined(__linux__)
+	pthread_t m_nativeThread;
+#endif
+
+	/// Options and the timer thread they apply to. Guarded by m_optionsLock.
+	WorkerThreadOptions m_options;
+	std::thread m_timerThread;
+	std::mutex m_optionsLock;
+
+	/// Signaled once the worker thread has started. Guarded by m_mutex.
+	std::condition_variable m_cvStarted;
+	bool m_optionsApplied;
+
+	/// Message queue per priority lane. Guarded by m_mutex.
+	std::deque<ThreadMsg*> m_queue[PRIORITY_LANES];
+
+	/// Number of messages in all lanes. Guarded by m_mutex.
+	size_t m_queueCount;
+
+	/// Weighted scheduling state. Guarded by m_mutex.
+	bool m_weighted;
+	UINT32 m_weights[PRIORITY_LANES];
+	UINT32 m_credits[PRIORITY_LANES];
+
+	/// Deferred callbacks. Only accessed by the worker thread.
+	std::deque<CallbackMsg*> m_deferred;
 	std::mutex m_mutex;
 	std::condition_variable m_cv;
+	std::condition_variable m_cvNotFull;
+	size_t m_capacity;
+	OverflowPolicy m_overflowPolicy;
+	bool m_exit;
+	std::atomic<UINT32> m_droppedOldest;
+	std::atomic<UINT32> m_droppedNewest;
+	std::atomic<UINT32> m_rejected;
+	std::atomic<UINT32> m_expired;
+
+	/// Queue depth readable without the lock while spinning
+	std::atomic<size_t> m_queueSize;
+
+	/// TRUE while the thread waits for a message. Guarded by m_mutex.
+	bool m_waiting;
+
+	/// TRUE while the thread is blocked in Park(). Guarded by m_mutex.
+	bool m_parked;
+
+	std::atomic<UINT32> m_pollInterval;
+
+	/// Time the first message was queued while waiting. Guarded by m_mutex.
+	INT64 m_wakeStampNs;
+
+	std::atomic<UINT32> m_spinCount;
+	std::atomic<UINT32> m_yieldCount;
+	std::atomic<UINT64> m_wakeCount[WAKE_PHASES];
+	std::atomic<UINT64> m_totalLatencyNs[WAKE_PHASES];
+	std::atomic<UINT64> m_maxLatencyNs[WAKE_PHASES];
+
+	std::atomic<size_t> m_queueHighWater;
+	std::atomic<UINT64> m_dispatchCount;
+	Heartbeat m_heartbeat;
+	CpuAccounting m_cpuAccounting;
+
+	/// The AsyncCallback of the message being timed for CPU accounting, 
+	/// otherwise NULL. The callback fields time one callback of a grouped
+	/// message. Only accessed by the worker thread. 
+	const CallbackTarget* m_sampledAsyncCallback;
+	bool m_sampledCallbacks;
+	Callback::CallbackFunc m_callbackFunc;
+	UINT64 m_callbackStartCpuNs;
+	INT64 m_callbackStartNs;
+
+#ifdef WORKER_THREAD_METRICS
+	/// Update the messages per second rate once each interval.
+	/// @param[in] nowNs - the current steady clock time in nanoseconds.
+	void UpdateRate(INT64 nowNs);
+
+	LatencyHistogram m_queueLatency;
+	LatencyHistogram m_executionTime;
+	std::atomic<UINT32> m_messagesPerSecond;
+	UINT64 m_rateDispatchCount = 0;
+	INT64 m_rateStartNs = 0;
+#endif
     std::atomic<bool> m_timerExit;
 	const std::string THREAD_NAME;
 };
@@ -16,15 +16,48 @@ SelfTestEngine& SelfTestEngine::GetInstance()
 //------------------------------------------------------------------------------
 SelfTestEngine::SelfTestEngine() :
 	SelfTest(ST_MAX_STATES),
-	m_thread("SelfTestEngine")
+	m_workerThread("SelfTestEngine"),
+	m_thread(&m_workerThread)
 {
-	StartCallback.Register(&SelfTestEngine::StartPrivateCallback, &m_thread, this);
+	RegisterCallbacks();
+}
+
+//------------------------------------------------------------------------------
+// SetThread
+//------------------------------------------------------------------------------
+void SelfTestEngine::SetThread(CallbackThread& thread)
+{
+	UnregisterCallbacks();
+	m_thread = &thread;
+	RegisterCallbacks();
+}
 
-	// Register for callbacks when sub self-test state machines complete or fail
-	m_centrifugeTest.CompletedCallback.Register(&SelfTestEngine::Complete, &m_thread, this);
-	m_centrifugeTest.FailedCallback.Register(&SelfTestEngine::Cancel, &m_thread, this);
-	m_pressureTest.CompletedCallback.Register(&SelfTestEngine::Complete, &m_thread, this);
-	m_pressureTest.FailedCallback.Register(&SelfTestEngine::Cancel, &m_thread, this);
+//------------------------------------------------------------------------------
+// RegisterCallbacks
+//------------------------------------------------------------------------------
+void SelfTestEngine::RegisterCallbacks()
+{
+	StartCallback.Register(&SelfTestEngine::StartPrivateCallback, m_thread, this);
+
+	// Register for callbacks when sub self-test state machines complete or fail.
+	// The sub self-tests run on m_thread so defer the callbacks on the same thread
+	// instead of sending them through the message queue.
+	m_centrifugeTest.CompletedCallback.Register(&SelfTestEngine::Complete, m_thread, this, DISPATCH_DEFERRED);
+	m_centrifugeTest.FailedCallback.Register(&SelfTestEngine::Cancel, m_thread, this, DISPATCH_DEFERRED);
+	m_pressureTest.CompletedCallback.Register(&SelfTestEngine::Complete, m_thread, this, DISPATCH_DEFERRED);
+	m_pressureTest.FailedCallback.Register(&SelfTestEngine::Cancel, m_thread, this, DISPATCH_DEFERRED);
+}
+
+//------------------------------------------------------------------------------
+// UnregisterCallbacks
+//------------------------------------------------------------------------------
+void SelfTestEngine::UnregisterCallbacks()
+{
+	StartCallback.Unregister(&SelfTestEngine::StartPrivateCallback, m_thread, this);
+	m_centrifugeTest.CompletedCallback.Unregister(&SelfTestEngine::Complete, m_thread, this);
+	m_centrifugeTest.FailedCallback.Unregister(&SelfTestEngine::Cancel, m_thread, this);
+	m_pressureTest.CompletedCallback.Unregister(&SelfTestEngine::Complete, m_thread, this);
+	m_pressureTest.FailedCallback.Unregister(&SelfTestEngine::Cancel, m_thread, this);
 }
 
 //------------------------------------------------------------------------------
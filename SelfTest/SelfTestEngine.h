@@ -27,7 +27,18 @@ public:
 	// Start the self-tests 
 	void Start();
 
-	WorkerThread& GetThread() { return m_thread; }
+	/// Get the thread all self-tests run on. 
+	CallbackThread& GetThread() { return *m_thread; }
+
+	/// Get the engine's own worker thread, the default self-test thread. 
+	/// The application creates and exits it.
+	WorkerThread& GetWorkerThread() { return m_workerThread; }
+
+	/// Run the self-tests on another thread, such as a DeterministicExecutor.
+	/// Call while idle, before Start(). The thread must outlive the self-tests.
+	/// @param[in] thread - the thread to run on.
+	void SetThread(CallbackThread& thread);
+
 	static void InvokeStatusCallback(std::string msg);
 
 private:
@@ -37,12 +48,19 @@ private:
 	SelfTestEngine();
 	void Complete();
 
+	/// Register or unregister the engine's callbacks on m_thread
+	void RegisterCallbacks();
+	void UnregisterCallbacks();
+
 	// Sub self-test state machines 
 	CentrifugeTest m_centrifugeTest;
 	PressureTest m_pressureTest;
 
-	// Worker thread used by all self-tests
-	WorkerThread m_thread;
+	// Default worker thread used by all self-tests
+	WorkerThread m_workerThread;
+
+	// Thread used by all self-tests. m_workerThread unless set by SetThread().
+	CallbackThread* m_thread;
 
 	// State enumeration order must match the order of state method entries
 	// in the state map.
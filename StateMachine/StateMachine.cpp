@@ -1,6 +1,8 @@
 // @see https://github.com/endurodave/StateMachine
 
 #include "StateMachine.h"
+#include "Heartbeat.h"
+#include <mutex>
 
 //----------------------------------------------------------------------------
 // StateMachine
@@ -10,7 +12,9 @@ StateMachine::StateMachine(BYTE maxStates, BYTE initialState) :
 	m_currentState(initialState),
 	m_newState(FALSE),
 	m_eventGenerated(FALSE),
-	m_pEventData(NULL)
+	m_pEventData(NULL),
+	m_stateObserver(NULL),
+	m_stateObserverData(NULL)
 {
 	ASSERT_TRUE(MAX_STATES < EVENT_IGNORED);
 }  
@@ -55,6 +59,50 @@ void StateMachine::InternalEvent(BYTE newState, const EventData* pData)
 	m_newState = newState;
 }
 
+//----------------------------------------------------------------------------
+// SetCurrentState
+//----------------------------------------------------------------------------
+void StateMachine::SetCurrentState(BYTE newState)
+{
+	m_currentState = newState;
+
+	// Let a watchdog report the machine and state a stalled thread is in
+	Heartbeat* heartbeat = Heartbeat::GetCurrent();
+	if (heartbeat)
+		heartbeat->SetState(this, typeid(*this).name(), newState);
+
+	StateObserver observer = m_stateObserver.load(std::memory_order_acquire);
+	if (observer)
+		(*observer)(this, newState, m_stateObserverData.load(std::memory_order_relaxed));
+}
+
+//----------------------------------------------------------------------------
+// SetStateObserver
+//----------------------------------------------------------------------------
+bool StateMachine::SetStateObserver(StateObserver observer, void* userData)
+{
+	ASSERT_TRUE(observer != NULL);
+
+	// Serialize installers so the user data is written before the observer
+	// is published
+	static std::mutex lock;
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (m_stateObserver.load(std::memory_order_relaxed) != NULL)
+		return false;
+	m_stateObserverData.store(userData, std::memory_order_relaxed);
+	m_stateObserver.store(observer, std::memory_order_release);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// ClearStateObserver
+//----------------------------------------------------------------------------
+void StateMachine::ClearStateObserver()
+{
+	m_stateObserver.store(NULL, std::memory_order_release);
+}
+
 //----------------------------------------------------------------------------
 // StateEngine
 //----------------------------------------------------------------------------
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <typeinfo>
 #include "Fault.h"
+#include <atomic>
 
 // See http://www.codeproject.com/Articles/1087619/State-Machine-Design-in-Cplusplus
 
@@ -180,6 +181,23 @@ public:
 	/// Gets the current state machine state.
 	/// @return Current state machine state.
 	BYTE GetCurrentState() { return m_currentState; }
+
+	/// State observer function signature. Called on the state machine's thread
+	/// each time the machine enters a state, before the state action executes.
+	/// @param[in] sm - the state machine instance.
+	/// @param[in] state - the new current state.
+	/// @param[in] userData - the user data passed to SetStateObserver().
+	typedef void (*StateObserver)(StateMachine* sm, BYTE state, void* userData);
+
+	/// Install the single state observer. May be called from any thread. 
+	/// @param[in] observer - the observer function. 
+	/// @param[in] userData - optional user data returned as-is on the callback.
+	/// @return TRUE if installed. FALSE if another observer is installed. 
+	bool SetStateObserver(StateObserver observer, void* userData = NULL);
+
+	/// Remove the installed state observer, if any. May be called from any thread
+	/// or from within the observer. 
+	void ClearStateObserver();
 	
 protected:
 	/// External state machine event.
@@ -209,6 +227,11 @@ private:
 	/// The state event data pointer.
 	const EventData* m_pEventData;
 
+	/// The state observer and its user data. The user data is written before
+	/// the observer is published.
+	std::atomic<StateObserver> m_stateObserver;
+	std::atomic<void*> m_stateObserverData;
+
 	/// Gets the state map as defined in the derived class. The BEGIN_STATE_MAP,
 	/// STATE_MAP_ENTRY and END_STATE_MAP macros are used to assist in creating the
 	/// map. A state machine only needs to return a state map using either GetStateMap()  
@@ -225,9 +248,9 @@ private:
 	/// NULL if the state machine uses the GetStateMap().
 	virtual const StateMapRowEx* GetStateMapEx() = 0;
 
-	/// Set a new current state.
+	/// Set a new current state and publish it to the thread's heartbeat, if any.
 	/// @param[in] newState - the new state.
-	void SetCurrentState(BYTE newState) { m_currentState = newState; }
+	void SetCurrentState(BYTE newState);
 
 	/// State machine engine that executes the external event and, optionally, all 
 	/// internal events generated during state execution.
@@ -306,13 +329,14 @@ private:
 	C_ASSERT((sizeof(STATE_MAP)/sizeof(StateMapRowEx)) == ST_MAX_STATES); \
    return &STATE_MAP[0]; }
 
+// Declares an AsyncCallback::TransferFunc that passes the heap allocated callback
+// data to the state machine event, which takes ownership. 
 #define CALLBACK_DECLARE(stateMachine, eventName, eventData) \
 	private:\
-	static void eventName(const eventData& data, void* userData) { \
+	static void eventName(eventData* data, void* userData) { \
 		ASSERT_TRUE(userData != NULL); \
 		stateMachine* stateMachine##Instance = static_cast<stateMachine*>(userData); \
-		eventData* eventData##Instance = new eventData(data); \
-		stateMachine##Instance->eventName(eventData##Instance); } 
+		stateMachine##Instance->eventName(data); } 
 
 #define CALLBACK_DECLARE_NO_DATA(stateMachine, eventName) \
 	private:\
@@ -0,0 +1,84 @@
+#include "Heartbeat.h"
+
+// The heartbeat published by the calling thread, if any
+static thread_local Heartbeat* currentHeartbeat = NULL;
+
+//----------------------------------------------------------------------------
+// Heartbeat
+//----------------------------------------------------------------------------
+Heartbeat::Heartbeat() :
+	m_sequence(0),
+	m_msgId(0),
+	m_func(NULL),
+	m_userData(NULL),
+	m_machine(NULL),
+	m_machineName(NULL),
+	m_state(0)
+{
+}
+
+//----------------------------------------------------------------------------
+// Begin
+//----------------------------------------------------------------------------
+void Heartbeat::Begin(UINT32 msgId, Function func, void* userData)
+{
+	m_msgId.store(msgId, std::memory_order_relaxed);
+	m_func.store(func, std::memory_order_relaxed);
+	m_userData.store(userData, std::memory_order_relaxed);
+	m_machine.store(NULL, std::memory_order_relaxed);
+
+	// Odd sequence while busy. Release publishes the fields above.
+	m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------
+// End
+//----------------------------------------------------------------------------
+void Heartbeat::End()
+{
+	m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------
+// SetState
+//----------------------------------------------------------------------------
+void Heartbeat::SetState(const void* machine, const char* machineName, BYTE state)
+{
+	m_machineName.store(machineName, std::memory_order_relaxed);
+	m_state.store(state, std::memory_order_relaxed);
+	m_machine.store(machine, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------
+// Read
+//----------------------------------------------------------------------------
+bool Heartbeat::Read(Sample& sample) const
+{
+	sample.sequence = m_sequence.load(std::memory_order_acquire);
+	sample.msgId = m_msgId.load(std::memory_order_relaxed);
+	sample.func = m_func.load(std::memory_order_relaxed);
+	sample.userData = m_userData.load(std::memory_order_relaxed);
+	sample.machine = m_machine.load(std::memory_order_acquire);
+	sample.machineName = m_machineName.load(std::memory_order_relaxed);
+	sample.state = m_state.load(std::memory_order_relaxed);
+
+	// Unchanged sequence means the fields belong to the same message
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return m_sequence.load(std::memory_order_relaxed) == sample.sequence;
+}
+
+//----------------------------------------------------------------------------
+// GetCurrent
+//----------------------------------------------------------------------------
+Heartbeat* Heartbeat::GetCurrent()
+{
+	return currentHeartbeat;
+}
+
+//----------------------------------------------------------------------------
+// SetCurrent
+//----------------------------------------------------------------------------
+void Heartbeat::SetCurrent(Heartbeat* heartbeat)
+{
+	currentHeartbeat = heartbeat;
+}
@@ -0,0 +1,81 @@
+#ifndef _HEARTBEAT_H
+#define _HEARTBEAT_H
+
+#include "DataTypes.h"
+#include <atomic>
+
+/// @brief A thread's record of the message it is currently handling, written
+/// by the owning thread and sampled by a watchdog thread.
+/// @details The sequence number is odd while a message is being handled and
+/// even while idle. A watchdog that sees the same odd sequence across its
+/// budget knows the handler has stalled. The owner never reads the clock, so
+/// publishing costs a few relaxed stores per message.
+class Heartbeat
+{
+public:
+	/// Generic function pointer type used to identify a handler
+	typedef void (*Function)(void);
+
+	/// @brief A consistent copy of the heartbeat fields.
+	struct Sample
+	{
+		UINT64 sequence;
+		UINT32 msgId;
+		Function func;
+		void* userData;
+		const void* machine;
+		const char* machineName;
+		BYTE state;
+	};
+
+	/// Constructor
+	Heartbeat();
+
+	/// Called by the owning thread when it starts handling a message.
+	/// @param[in] msgId - the thread message ID.
+	/// @param[in] func - the callback function or NULL.
+	/// @param[in] userData - the callback user data or NULL.
+	void Begin(UINT32 msgId, Function func, void* userData);
+
+	/// Called by the owning thread when it finishes handling a message.
+	void End();
+
+	/// Called by the owning thread when a state machine changes state while
+	/// handling the current message.
+	/// @param[in] machine - the state machine instance.
+	/// @param[in] machineName - the state machine type name. Must have static
+	///		storage duration.
+	/// @param[in] state - the new current state.
+	void SetState(const void* machine, const char* machineName, BYTE state);
+
+	/// Get the current sequence number. May be called from any thread.
+	UINT64 GetSequence() const { return m_sequence.load(std::memory_order_acquire); }
+
+	/// Read the heartbeat fields. May be called from any thread.
+	/// @param[out] sample - the fields.
+	/// @return TRUE if the sample is consistent. FALSE if the owning thread
+	///		moved on to another message while reading.
+	bool Read(Sample& sample) const;
+
+	/// Get the heartbeat published by the calling thread.
+	/// @return The heartbeat or NULL if the calling thread has none.
+	static Heartbeat* GetCurrent();
+
+	/// Set the heartbeat published by the calling thread.
+	/// @param[in] heartbeat - the heartbeat or NULL.
+	static void SetCurrent(Heartbeat* heartbeat);
+
+private:
+	Heartbeat(const Heartbeat&) = delete;
+	Heartbeat& operator=(const Heartbeat&) = delete;
+
+	std::atomic<UINT64> m_sequence;
+	std::atomic<UINT32> m_msgId;
+	std::atomic<Function> m_func;
+	std::atomic<void*> m_userData;
+	std::atomic<const void*> m_machine;
+	std::atomic<const char*> m_machineName;
+	std::atomic<BYTE> m_state;
+};
+
+#endif
@@ -45,7 +45,7 @@ int main(void)
 {	
 	// Create the worker threads
 	userInterfaceThread.CreateThread();
-	SelfTestEngine::GetInstance().GetThread().CreateThread();
+	SelfTestEngine::GetInstance().GetWorkerThread().CreateThread();
 
 	// Register for self-test engine callbacks
 	SelfTestEngine::StatusCallback.Register(&SelfTestEngineStatusCallback, &userInterfaceThread);
@@ -60,7 +60,7 @@ int main(void)
 
 	// Exit the worker threads
 	userInterfaceThread.ExitThread();
-	SelfTestEngine::GetInstance().GetThread().ExitThread();
+	SelfTestEngine::GetInstance().GetWorkerThread().ExitThread();
 
 	return 0;
 }